@@ -452,10 +452,12 @@ static s32_t cli_info(u32_t argc) {
 
 CLI_EXTERN_MENU(common)
 CLI_EXTERN_MENU(wifi)
+CLI_EXTERN_MENU(lamp)
 
 CLI_MENU_START_MAIN
 CLI_EXTRAMENU(common)
 CLI_SUBMENU(wifi, "wifi", "SUBMENU: wifi module")
+CLI_SUBMENU(lamp, "lamp", "SUBMENU: lamp")
 #ifndef SENSORS_DISABLE
 CLI_FUNC("temp", cli_temp, "Reads temperature")
 #endif
@@ -77,4 +77,40 @@ void APP_report_data(
 
 void WB_init(void);
 
+typedef void (* WB_rx_fn)(u8_t *data, u16_t len);
+typedef void (* WB_ack_fn)(u8_t seqno, u8_t *data, u16_t len);
+/**
+ * Registers handler for packets from the ESP8266 with given id, see
+ * proto_stm. Packets shorter than min_len are dropped. May be called
+ * before WB_init.
+ */
+void WB_register_rx(u8_t id, u16_t min_len, WB_rx_fn fn);
+/**
+ * Registers handler for acks carrying data for packets sent to the
+ * ESP8266 with given id, see proto_efm. Shorter acks are dropped.
+ */
+void WB_register_ack(u8_t id, u16_t min_len, WB_ack_fn fn);
+/**
+ * Acks the packet being handled with data, only valid within a
+ * WB_rx_fn.
+ */
+int WB_reply(u8_t *buf, u16_t len);
+/**
+ * Sends a synchronized message to the ESP8266, fragmented if longer
+ * than a umac packet. The buffer must be kept until acked or timed out.
+ * Returns negative on error.
+ */
+int WB_tx_msg(u8_t *buf, u16_t len);
+/**
+ * Tells the ESP8266 that lamp state changed. The state is pushed a bit
+ * later, so a burst of changes is sent once.
+ */
+void WB_lamp_changed(void);
+#ifdef CONFIG_WIFI_RX_RING
+/**
+ * Called first thing in the wifi uart irq, takes care of rx.
+ */
+void WB_uart_rx_irq(void);
+#endif
+
 #endif /* APP_H_ */
@@ -10,11 +10,15 @@
 #include "taskq.h"
 
 #include "umac.h"
+#include "umac_frag.h"
+#include "umac_lz.h"
 #include "cli.h"
 
 #include "protocol.h"
 
 #include "lamp.h"
+#include "app.h"
+#include "processor.h"
 
 static volatile bool um_uart_rd;
 
@@ -25,10 +29,55 @@ static u8_t rx_buf[768];
 static u8_t tx_buf[768];
 static u8_t tx_ack_buf[768];
 static umac um;
+static umac_frag frag;
 static task_timer umac_timer;
 static task *umac_timer_task;
 static u32_t ping_val;
 static sys_time ping_snd;
+static task_timer lamp_push_timer;
+static task *lamp_push_task;
+static volatile bool lamp_push_pending;
+static u8_t lamp_pushed[6];
+// synchronized push, left untouched until acked or timed out as umac
+// resends from it
+static u8_t lamp_push_pkt[6];
+static u8_t lamp_push_seqno;
+#ifdef CFG_UMAC_LZ
+static u8_t lz_buf[768];
+#endif
+
+#ifdef CFG_UMAC_SLIP
+#define WB_CAP_SLIP   (P_CAP_SLIP)
+#else
+#define WB_CAP_SLIP   (0)
+#endif
+#ifdef CFG_UMAC_LZ
+#define WB_CAP_LZ     (P_CAP_LZ)
+#else
+#define WB_CAP_LZ     (0)
+#endif
+#define WB_CAPS       (WB_CAP_SLIP | WB_CAP_LZ)
+
+// lamp changes are collected for this long before pushed to esp
+#define WB_LAMP_PUSH_MS  50
+
+typedef struct {
+  WB_rx_fn rx_fn;
+  WB_ack_fn ack_fn;
+  u16_t min_len;
+  u32_t calls;
+  u32_t cycles;
+} wb_handler;
+
+// handlers of packets from esp, and of acks to packets sent to esp
+static wb_handler rx_handlers[_P_STM_CNT];
+static wb_handler ack_handlers[_P_ESP_CNT];
+
+static void um_apply_caps(u8_t caps) {
+#ifdef CFG_UMAC_SLIP
+  umac_set_framing(&um, (caps & P_CAP_SLIP) ? UMAC_FRAMING_SLIP : UMAC_FRAMING_RAW);
+#endif
+}
 
 static u8_t * u32tomem(u8_t *b, uint32_t v) {
   *b++ = v>>24;
@@ -72,25 +121,73 @@ static void um_impl_tx_buf(u8_t *b, u16_t len) {
   IO_put_buf(IOWIFI, b, len);
 }
 
+// push lamp status to esp unless it is the same as last acked, one push in
+// flight at a time, lamp_pushed is only updated on ack so a lost push is
+// sent again
+static void lamp_push(u32_t a, void *p) {
+  lamp_push_pending = FALSE;
+  // pushed again on ack or timeout if status changed meanwhile
+  if (lamp_push_seqno) return;
+  u8_t pkt[6];
+  u16_t ix = 0;
+  u32_t rgb = LAMP_get_color();
+  pkt[ix++] = P_ESP_LAMP_STATUS;
+  pkt[ix++] = LAMP_on();
+  pkt[ix++] = LAMP_get_intensity();
+  pkt[ix++] = rgb>>16;
+  pkt[ix++] = rgb>>8;
+  pkt[ix++] = rgb;
+  if (memcmp(pkt, lamp_pushed, sizeof(pkt)) == 0) return;
+  memcpy(lamp_push_pkt, pkt, sizeof(pkt));
+  int res = umac_tx_pkt(&um, TRUE, lamp_push_pkt, ix);
+  if (res > 0) {
+    lamp_push_seqno = res;
+  } else {
+    // tx window full, try again later
+    WB_lamp_changed();
+  }
+}
+
+static void lamp_push_acked(u8_t seqno) {
+  if (lamp_push_seqno == 0 || seqno != lamp_push_seqno) return;
+  memcpy(lamp_pushed, lamp_push_pkt, sizeof(lamp_pushed));
+  lamp_push_seqno = 0;
+  WB_lamp_changed();
+}
+
+static void lamp_push_timeout(u8_t seqno) {
+  if (lamp_push_seqno == 0 || seqno != lamp_push_seqno) return;
+  lamp_push_seqno = 0;
+  WB_lamp_changed();
+}
+
 static void um_impl_tx_pkt_acked(u8_t seqno, u8_t *data, u16_t len) {
+  umac_frag_on_ack(&frag, seqno);
+  lamp_push_acked(seqno);
   if (len == 0) return;
-  switch(data[0]) {
-  case P_ESP_HELLO: {
-    sys_time ping_rcv = SYS_get_time_ms();
-    u32_t rec_ping_val = memtou32(&data[1]);
-    if (rec_ping_val == ping_val) {
-      print("PONG ok, turnaround %i ms\n", ping_rcv - ping_snd);
-    } else {
-      print("PONG bad, turnaround %i ms\n", ping_rcv - ping_snd);
-    }
-  }
-    break;
-  default:
-    break;
+  u8_t id = data[0];
+  wb_handler *h = id < _P_ESP_CNT ? &ack_handlers[id] : NULL;
+  if (h == NULL || h->ack_fn == NULL || len < h->min_len) return;
+  u32_t t0 = DWT_CYCCNT;
+  h->ack_fn(seqno, data, len);
+  h->calls++;
+  h->cycles += DWT_CYCCNT - t0;
+}
+
+static void wb_ack_hello(u8_t seqno, u8_t *data, u16_t len) {
+  sys_time ping_rcv = SYS_get_time_ms();
+  u32_t rec_ping_val = memtou32(&data[1]);
+  if (rec_ping_val == ping_val) {
+    print("PONG ok, turnaround %i ms\n", ping_rcv - ping_snd);
+  } else {
+    print("PONG bad, turnaround %i ms\n", ping_rcv - ping_snd);
   }
+  um_apply_caps(len >= 6 ? data[5] : 0);
 }
 
 static void um_impl_timeout(umac_pkt *pkt) {
+  if (umac_frag_on_timeout(&frag, pkt->seqno)) return;
+  lamp_push_timeout(pkt->seqno);
   if (pkt->length == 0) return;
   if (pkt->data[0] == P_ESP_HELLO) {
     print("PONG missed\n");
@@ -125,90 +222,171 @@ static void task_tick(u32_t a, void *p) {
   umac_tick(&um);
 }
 
-static void um_impl_rx_pkt(umac_pkt *pkt) {
-  print("pkt %02x\n", pkt->data[0]);
-  switch (pkt->data[0])  {
-  case P_STM_HELLO: {
-    memcpy(tx_ack_buf, pkt->data, pkt->length);
-    umac_tx_reply_ack(&um, tx_ack_buf, pkt->length);
-  }
-  break;
-  case P_STM_LAMP_ENA: {
-    LAMP_enable(pkt->data[1] != 0);
-  }
-  break;
-  case P_STM_LAMP_INTENSITY: {
-    u32_t i = pkt->data[1];
-    if (i < LAMP_MIN_INTENSITY) {
-      LAMP_enable(FALSE);
-    } else {
-      LAMP_set_intensity(i);
-      LAMP_enable(TRUE);
-    }
-  }
-  break;
-  case P_STM_LAMP_COLOR: {
-    u32_t rgb = (pkt->data[1] << 16) | (pkt->data[2] << 8) | (pkt->data[3]);
-    LAMP_set_color(rgb);
+static void wb_dispatch_rx(u8_t *data, u16_t len) {
+  if (len == 0) return;
+  u8_t id = data[0];
+  wb_handler *h = id < _P_STM_CNT ? &rx_handlers[id] : NULL;
+  if (h == NULL || h->rx_fn == NULL) {
+    print("unhandled pkt %02x\n", id);
+    return;
   }
-  break;
-  case P_STM_LAMP_STATUS: {
-    LAMP_enable(pkt->data[1] != 0);
-    LAMP_set_intensity(pkt->data[2]);
-    LAMP_set_color((pkt->data[3] << 16) | (pkt->data[4] << 8) | (pkt->data[5]));
+  if (len < h->min_len) {
+    print("short pkt %02x, %i bytes\n", id, len);
+    return;
   }
-  break;
-  case P_STM_LAMP_GET_ENA: {
-    u16_t ix = 0;
-    tx_ack_buf[ix++] = pkt->data[0];
-    tx_ack_buf[ix++] = LAMP_on();
-    umac_tx_reply_ack(&um, tx_ack_buf, ix);
+  u32_t t0 = DWT_CYCCNT;
+  h->rx_fn(data, len);
+  h->calls++;
+  h->cycles += DWT_CYCCNT - t0;
+}
+
+static void um_impl_rx_pkt(umac_pkt *pkt) {
+  wb_dispatch_rx(pkt->data, pkt->length);
+}
+
+static void wb_rx_hello(u8_t *data, u16_t len) {
+  memcpy(tx_ack_buf, data, len);
+  u8_t caps = 0;
+  if (len >= 6) {
+    caps = data[5] & WB_CAPS;
+    tx_ack_buf[5] = caps;
   }
-  break;
-  case P_STM_LAMP_GET_INTENSITY: {
-    u16_t ix = 0;
-    tx_ack_buf[ix++] = pkt->data[0];
-    tx_ack_buf[ix++] = LAMP_get_intensity();
-    umac_tx_reply_ack(&um, tx_ack_buf, ix);
+  WB_reply(tx_ack_buf, len);
+  um_apply_caps(caps);
+  // esp might have restarted, make sure it gets current lamp state
+  lamp_pushed[0] = 0;
+  WB_lamp_changed();
+}
+
+static void wb_rx_frag(u8_t *data, u16_t len) {
+  umac_frag_rx(&frag, &data[1], len - 1);
+}
+
+static void wb_rx_recv_udp(u8_t *data, u16_t len) {
+  u16_t udp_len = len - 5;
+  print("Got UDP data from %i.%i.%i.%i, %i bytes\n", data[4], data[3], data[2], data[1], udp_len);
+  printbuf(IOSTD, &data[5], udp_len);
+}
+
+static void wb_rx_udp_data(u8_t *data, u16_t len) {
+  u16_t udp_len = len - 8;
+  print("Got UDP data from %i.%i.%i.%i:%i, %i bytes", data[1], data[2], data[3], data[4],
+      (data[5] << 8) | data[6], udp_len);
+  if (data[7]) print(", %i dropped before", data[7]);
+  print("\n");
+  printbuf(IOSTD, &data[8], udp_len);
+}
+
+static void wb_ack_udp_subscribe(u8_t seqno, u8_t *data, u16_t len) {
+  print("UDP subscription to port %i %s\n", (data[1] << 8) | data[2], data[3] ? "failed" : "ok");
+}
+
+// containers never nest, anything else would let a peer recurse the stack
+static bool wb_is_container(u8_t id) {
+  return id == P_STM_FRAG || id == P_STM_LZ || id == P_STM_BATCH;
+}
+
+static void wb_rx_batch(u8_t *data, u16_t len) {
+  u16_t ix = 1;
+  while (ix < len) {
+    u8_t sub_len = data[ix++];
+    if (sub_len == 0 || ix + sub_len > len || wb_is_container(data[ix])) {
+      print("bad batch pkt\n");
+      break;
+    }
+    wb_dispatch_rx(&data[ix], sub_len);
+    ix += sub_len;
   }
-  break;
-  case P_STM_LAMP_GET_COLOR: {
-    u16_t ix = 0;
-    u32_t rgb = LAMP_get_color();
-    tx_ack_buf[ix++] = pkt->data[0];
-    tx_ack_buf[ix++] = rgb>>16;
-    tx_ack_buf[ix++] = rgb>>8;
-    tx_ack_buf[ix++] = rgb;
-    umac_tx_reply_ack(&um, tx_ack_buf, ix);
+}
+
+#ifdef CFG_UMAC_LZ
+static void wb_rx_lz(u8_t *data, u16_t len) {
+  int lz_len = umac_lz_decompress(&data[1], len - 1, lz_buf, sizeof(lz_buf));
+  if (lz_len <= 0 || wb_is_container(lz_buf[0])) {
+    print("bad lz pkt\n");
+    return;
   }
-  break;
-  case P_STM_LAMP_GET_STATUS: {
-    u16_t ix = 0;
-    u32_t rgb = LAMP_get_color();
-    tx_ack_buf[ix++] = pkt->data[0];
-    tx_ack_buf[ix++] = LAMP_on();
-    tx_ack_buf[ix++] = LAMP_get_intensity();
-    tx_ack_buf[ix++] = rgb>>16;
-    tx_ack_buf[ix++] = rgb>>8;
-    tx_ack_buf[ix++] = rgb;
-    print("tx lamp ena:%i int:%i rgb:%02x%02x%02x\n", tx_ack_buf[1], tx_ack_buf[2], tx_ack_buf[3], tx_ack_buf[4], tx_ack_buf[5]);
-    umac_tx_reply_ack(&um, tx_ack_buf, ix);
+  wb_dispatch_rx(lz_buf, lz_len);
+}
+#endif
+
+static int um_frag_tx(const umac_seg *segs, u8_t nsegs) {
+  return umac_tx_pktv(&um, TRUE, segs, nsegs);
+}
+
+static void um_frag_rx_msg(u8_t *data, u16_t len) {
+  if (len == 0 || wb_is_container(data[0])) return;
+  wb_dispatch_rx(data, len);
+}
+
+#ifdef CONFIG_WIFI_RX_RING
+
+#if (WIFI_RX_RING_SIZE & (WIFI_RX_RING_SIZE - 1)) != 0
+#error WIFI_RX_RING_SIZE must be a power of two
+#endif
+
+static u8_t rx_ring[WIFI_RX_RING_SIZE];
+static volatile u16_t rx_ring_w;
+static volatile u16_t rx_ring_r;
+static struct {
+  volatile u32_t bytes;
+  volatile u32_t drains;
+  volatile u32_t spans;
+  volatile u32_t overruns;
+  volatile u32_t ring_full;
+  volatile u16_t max_fill;
+} rx_stat;
+
+static void um_task_on_ring(u32_t a, void *p) {
+  u16_t w;
+  um_uart_rd = FALSE;
+  rx_stat.drains++;
+  while ((w = rx_ring_w) != rx_ring_r) {
+    u16_t r = rx_ring_r;
+    // feed contiguous span up to write index or ring end
+    u16_t len = w > r ? w - r : WIFI_RX_RING_SIZE - r;
+    umac_report_rx_buf(&um, &rx_ring[r], len);
+    rx_ring_r = (r + len) & (WIFI_RX_RING_SIZE - 1);
+    rx_stat.spans++;
   }
-  break;
-  case P_STM_RECV_UDP: {
-    //u32_t ipaddr = memtou32(&pkt->data[1]);
-    u16_t udp_len = pkt->length-5;
-    print("Got UDP data from %i.%i.%i.%i, %i bytes\n", pkt->data[4], pkt->data[3], pkt->data[1], pkt->data[1], udp_len);
-    printbuf(IOSTD, &pkt->data[5], udp_len);
-    break;
+}
+
+static void um_trig_ring_drain(void) {
+  if (!um_uart_rd) {
+    task *t = TASK_create(um_task_on_ring, 0);
+    TASK_run(t, 0, NULL);
+    um_uart_rd = TRUE;
   }
+}
 
-  default:
-    print("unhandled pkt %02x\n", pkt->data[0]);
-  break;
+void WB_uart_rx_irq(void) {
+  u16_t sr = USART1->SR;
+  if (sr & (USART_SR_RXNE | USART_SR_ORE)) {
+    // reading dr after sr clears rxne, ore and idle
+    u8_t c = USART1->DR;
+    u16_t w = rx_ring_w;
+    u16_t nw = (w + 1) & (WIFI_RX_RING_SIZE - 1);
+    if (sr & USART_SR_ORE) rx_stat.overruns++;
+    if (nw == rx_ring_r) {
+      rx_stat.ring_full++;
+    } else {
+      rx_ring[w] = c;
+      rx_ring_w = nw;
+      rx_stat.bytes++;
+    }
+    u16_t fill = (nw - rx_ring_r) & (WIFI_RX_RING_SIZE - 1);
+    if (fill > rx_stat.max_fill) rx_stat.max_fill = fill;
+    if ((sr & USART_SR_IDLE) || fill >= WIFI_RX_RING_SIZE/2) {
+      um_trig_ring_drain();
+    }
+  } else if (sr & USART_SR_IDLE) {
+    (void)USART1->DR;
+    um_trig_ring_drain();
   }
 }
 
+#else
+
 static void um_task_on_input(u32_t io, void *p) {
   while (IO_rx_available(io)) {
     u8_t chunk[32];
@@ -226,6 +404,24 @@ static void um_rx_avail_irq(u8_t io, void *arg, u16_t available) {
   }
 }
 
+#endif // CONFIG_WIFI_RX_RING
+
+void WB_register_rx(u8_t id, u16_t min_len, WB_rx_fn fn) {
+  if (id >= _P_STM_CNT) return;
+  rx_handlers[id].rx_fn = fn;
+  rx_handlers[id].min_len = min_len;
+}
+
+void WB_register_ack(u8_t id, u16_t min_len, WB_ack_fn fn) {
+  if (id >= _P_ESP_CNT) return;
+  ack_handlers[id].ack_fn = fn;
+  ack_handlers[id].min_len = min_len;
+}
+
+int WB_reply(u8_t *buf, u16_t len) {
+  return umac_tx_reply_ack(&um, buf, len);
+}
+
 void WB_init(void) {
   IO_assure_tx(IOWIFI, TRUE);
   um_uart_rd = FALSE;
@@ -238,6 +434,8 @@ void WB_init(void) {
       UART_FLOWCONTROL_NONE,
       TRUE);
   umac_timer_task = TASK_create(task_tick, TASK_STATIC);
+  lamp_push_task = TASK_create(lamp_push, TASK_STATIC);
+  lamp_push_pending = FALSE;
   umac_cfg cfg = {
       .timer_fn = um_impl_request_future_tick,
       .cancel_timer_fn = um_impl_cancel_future_tick,
@@ -250,9 +448,45 @@ void WB_init(void) {
       .nonprotocol_data_fn = um_impl_nonprotocol_data
   };
   umac_init(&um, &cfg, rx_buf);
+  umac_frag_cfg frag_cfg = {
+      .tx_fn = um_frag_tx,
+      .rx_msg_fn = um_frag_rx_msg,
+      .tx_done_fn = NULL,
+      .container_id = P_ESP_FRAG
+  };
+  umac_frag_init(&frag, &frag_cfg);
+
+  WB_register_rx(P_STM_HELLO, 5, wb_rx_hello);
+  WB_register_rx(P_STM_RECV_UDP, 5, wb_rx_recv_udp);
+  WB_register_rx(P_STM_UDP_DATA, 8, wb_rx_udp_data);
+  WB_register_rx(P_STM_FRAG, UMAC_FRAG_HDR_LEN, wb_rx_frag);
+  WB_register_rx(P_STM_BATCH, 1, wb_rx_batch);
+#ifdef CFG_UMAC_LZ
+  WB_register_rx(P_STM_LZ, 2, wb_rx_lz);
+#endif
+  WB_register_ack(P_ESP_HELLO, 5, wb_ack_hello);
+  WB_register_ack(P_ESP_UDP_SUBSCRIBE, 4, wb_ack_udp_subscribe);
+#ifdef CONFIG_WIFI_RX_RING
+  rx_ring_r = rx_ring_w = 0;
+  USART1->CR1 |= USART_CR1_IDLEIE;
+#else
   IO_set_callback(IOWIFI, um_rx_avail_irq, NULL);
+#endif
+}
+
+
+int WB_tx_msg(u8_t *buf, u16_t len) {
+  if (len <= UMAC_MAX_LEN) {
+    return umac_tx_pkt(&um, TRUE, buf, len);
+  }
+  return umac_frag_tx(&frag, buf, len);
 }
 
+void WB_lamp_changed(void) {
+  if (lamp_push_pending) return;
+  lamp_push_pending = TRUE;
+  TASK_start_timer(lamp_push_task, &lamp_push_timer, 0, NULL, WB_LAMP_PUSH_MS, 0, "lmppush");
+}
 
 static s32_t cli_udp_tx(u32_t argc) {
   tx_buf[0] = P_ESP_SEND_UDP;
@@ -272,11 +506,26 @@ static s32_t cli_udp_rx(u32_t argc) {
   return CLI_OK;
 }
 
+static s32_t cli_udp_sub(u32_t argc, u32_t port) {
+  tx_buf[0] = P_ESP_UDP_SUBSCRIBE;
+  u16tomem(&tx_buf[1], port);
+  umac_tx_pkt(&um, TRUE, tx_buf, 3);
+  return CLI_OK;
+}
+
+static s32_t cli_udp_unsub(u32_t argc, u32_t port) {
+  tx_buf[0] = P_ESP_UDP_UNSUBSCRIBE;
+  u16tomem(&tx_buf[1], port);
+  umac_tx_pkt(&um, TRUE, tx_buf, 3);
+  return CLI_OK;
+}
+
 static s32_t cli_hello(u32_t argc) {
   ping_val = rand_next();
   tx_buf[0] = P_ESP_HELLO;
   u32tomem(&tx_buf[1], ping_val);
-  umac_tx_pkt(&um, TRUE, tx_buf, 5);
+  tx_buf[5] = WB_CAPS;
+  umac_tx_pkt(&um, TRUE, tx_buf, 6);
   ping_snd = SYS_get_time_ms();
   return CLI_OK;
 }
@@ -299,11 +548,81 @@ static s32_t cli_apcfg(u32_t argc, char *ssid, char *pass) {
   return CLI_OK;
 }
 
+static s32_t cli_stats(u32_t argc, u32_t reset) {
+#ifdef CFG_UMAC_STATS
+  umac_stats *st = &um.stats;
+  print("tx pkts:%i bytes:%i\n", st->tx_pkts, st->tx_bytes);
+  print("rx pkts:%i bytes:%i\n", st->rx_pkts, st->rx_bytes);
+  print("retransmits:%i timeouts:%i rx timeouts:%i\n", st->retransmits, st->timeouts, st->rx_timeouts);
+  print("crc errors:%i garbage:%i\n", st->crc_errors, st->garbage);
+  print("nacks tx  unkn:%i preamble:%i crc:%i rxtmo:%i notready:%i\n",
+      st->tx_nacks[0], st->tx_nacks[UMAC_NACK_ERR_NOT_PREAMBLE], st->tx_nacks[UMAC_NACK_ERR_BAD_CRC],
+      st->tx_nacks[UMAC_NACK_ERR_RX_TIMEOUT], st->tx_nacks[UMAC_NACK_ERR_NOT_READY]);
+  print("nacks rx  unkn:%i preamble:%i crc:%i rxtmo:%i notready:%i\n",
+      st->rx_nacks[0], st->rx_nacks[UMAC_NACK_ERR_NOT_PREAMBLE], st->rx_nacks[UMAC_NACK_ERR_BAD_CRC],
+      st->rx_nacks[UMAC_NACK_ERR_RX_TIMEOUT], st->rx_nacks[UMAC_NACK_ERR_NOT_READY]);
+  print("ack latency\n");
+  int i;
+  for (i = 0; i < UMAC_STATS_LAT_BUCKETS; i++) {
+    if (i < UMAC_STATS_LAT_BUCKETS - 1) {
+      print("  <%4i ms : %i\n", 2 << i, st->ack_lat[i]);
+    } else {
+      print("  >=%3i ms : %i\n", 1 << i, st->ack_lat[i]);
+    }
+  }
+  if (argc > 0 && reset) {
+    umac_stats_reset(&um);
+  }
+  return CLI_OK;
+#else
+  print("umac stats not enabled, define CFG_UMAC_STATS\n");
+  return CLI_OK;
+#endif
+}
+
+static void wb_prof_dump(const char *what, wb_handler *tbl, u8_t cnt, bool reset) {
+  u8_t i;
+  for (i = 0; i < cnt; i++) {
+    wb_handler *h = &tbl[i];
+    if (h->calls == 0) continue;
+    print("%s %02x calls:%i cycles:%i avg:%i us\n", what, i, h->calls, h->cycles,
+        h->cycles / h->calls / (SystemCoreClock / 1000000));
+    if (reset) {
+      h->calls = 0;
+      h->cycles = 0;
+    }
+  }
+}
+
+static s32_t cli_prof(u32_t argc, u32_t reset) {
+  bool r = argc > 0 && reset;
+  print("handler profile, containers include nested packets\n");
+  wb_prof_dump("rx ", rx_handlers, _P_STM_CNT, r);
+  wb_prof_dump("ack", ack_handlers, _P_ESP_CNT, r);
+  return CLI_OK;
+}
+
+#ifdef CONFIG_WIFI_RX_RING
+static s32_t cli_uart(u32_t argc) {
+  print("rx bytes:%i drains:%i spans:%i\n", rx_stat.bytes, rx_stat.drains, rx_stat.spans);
+  print("rx overruns:%i ring full:%i max fill:%i/%i\n", rx_stat.overruns, rx_stat.ring_full,
+      rx_stat.max_fill, WIFI_RX_RING_SIZE);
+  return CLI_OK;
+}
+#endif
+
 CLI_MENU_START(wifi)
 CLI_FUNC("ping", cli_hello, "Pings ESP8266")
 CLI_FUNC("udp_tx", cli_udp_tx, "Test send an UDP broadcast to port 12345")
 CLI_FUNC("udp_rx", cli_udp_rx, "Test receive an UDP broadcast to port 12345")
+CLI_FUNC("udp_sub", cli_udp_sub, "Relay all UDP datagrams to port, <port>")
+CLI_FUNC("udp_unsub", cli_udp_unsub, "Stop relaying UDP datagrams to port, <port>")
 CLI_FUNC("apscan", cli_apscan, "Request an AP scan")
 CLI_FUNC("apcfg", cli_apcfg, "Set AP, <ssid> <passw>")
+CLI_FUNC("stats", cli_stats, "Dumps umac statistics, (<reset 0/1>)")
+CLI_FUNC("prof", cli_prof, "Dumps packet handler profile, (<reset 0/1>)")
+#ifdef CONFIG_WIFI_RX_RING
+CLI_FUNC("uart", cli_uart, "Dumps wifi uart rx statistics")
+#endif
 CLI_MENU_END
 
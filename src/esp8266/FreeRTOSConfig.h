@@ -6,6 +6,8 @@
 
 /* The serial driver depends on counting semaphores */
 #define configUSE_COUNTING_SEMAPHORES 1
+/* umac mutex is taken again by callbacks replying from within umac */
+#define configUSE_RECURSIVE_MUTEXES 1
 
 /* Use the defaults for everything else */
 #include_next<FreeRTOSConfig.h>
@@ -17,22 +17,137 @@
 #include "FreeRTOS.h"
 #include "task.h"
 #include "queue.h"
+#include "semphr.h"
+#include "timers.h"
 #include "udputil.h"
 #include "systasks.h"
 #include "../protocol.h"
 #include "fs.h"
 #include <esp/hwrand.h>
+#include "espressif/esp_common.h"
+#include "../umac/umac_frag.h"
+#include "../umac/umac_lz.h"
 
-static xQueueHandle syncq;
-static uint32_t sync_seqno;
 static lamp_status lamp;
 static uint32_t ping_val;
+static uint8_t udp_pkt_preamble[5];
+static uint8_t udp_rx_buf[512];
+static umac_frag frag;
+static uint8_t peer_caps;
+
+// max number of synchronized requests awaiting ack at a time
+#define BRIDGE_MAX_REQUESTS   8
+
+typedef struct {
+  bool busy;               // set until waiter or callback is done with entry
+  uint8_t seqno;           // 0 if not awaiting ack
+  uint32_t gen;            // order of issue, oldest completes first on seqno reuse
+  xSemaphoreHandle sem;    // given on completion if no callback
+  uint8_t *rsp;
+  uint16_t rsp_max;
+  int res;
+  bridge_req_cb cb;
+  void *arg;
+} bridge_req;
+
+// request table is guarded by um_mutex, completions come from within umac
+static bridge_req reqs[BRIDGE_MAX_REQUESTS];
+static uint32_t req_gen;
+
+typedef struct {
+  bridge_rx_fn rx_fn;
+  bridge_ack_fn ack_fn;
+  uint16_t min_len;
+  uint32_t calls;
+  uint32_t us;
+} bridge_handler;
+
+// handlers of packets from stm, and of acks to packets sent to stm
+static bridge_handler rx_handlers[_P_ESP_CNT];
+static bridge_handler ack_handlers[_P_STM_CNT];
+
+// datagrams on subscribed ports awaiting relay to stm
+#define BRIDGE_UDP_QUEUE_LEN  4
+
+// P_STM_UDP_DATA preamble preceding the datagram
+#define BRIDGE_UDP_HDR_LEN    8
+
+typedef struct {
+  uint32_t ip;
+  uint16_t src_port;
+  uint16_t len;
+  // preamble is filled in when relayed, so a long datagram can be sent as
+  // one fragmented message
+  uint8_t pkt[BRIDGE_UDP_HDR_LEN + UDPUTIL_LISTEN_MAX_LEN];
+} bridge_udp_dgram;
+
+static xQueueHandle udp_sub_q;
+static uint16_t udp_sub_ports[UDPUTIL_MAX_LISTENERS];
+static bridge_udp_dgram udp_sub_rx;   // filled by udp listener task
+static bridge_udp_dgram udp_sub_fwd;  // relayed by udp_fwd task
+static xSemaphoreHandle frag_done_sem;
+static volatile uint8_t frag_done_msgid;
+static volatile int frag_done_res;
+static bridge_udp_stats udp_stats;
+static uint32_t udp_drops_told;
+
+// leds per P_STM_LAMP_FRAME packet
+#define BRIDGE_FRAME_PKT_LEDS     240
+
+static uint8_t frame_seq;
+static uint8_t frame_hdr[5];
+
+// lamp commands are coalesced for this long before sent as one packet
+#define BRIDGE_BATCH_WINDOW   (20/portTICK_RATE_MS)
+
+typedef enum {
+  BATCH_ENA = 0,
+  BATCH_INTENSITY,
+  BATCH_COLOR,
+  _BATCH_ITEMS
+} batch_item;
+
 static struct {
-  uint8_t udp_pkt_preamble[5];
-  uint8_t udp_rx_buf[512];
-} udp_rx;
+  uint8_t order[_BATCH_ITEMS]; // pending items, in order of first write
+  uint8_t cnt;
+  bool ena;
+  uint8_t intensity;
+  uint32_t rgb;
+} batch;
+static xSemaphoreHandle batch_mutex;
+static xTimerHandle batch_tim;
+#ifdef CFG_UMAC_LZ
+static umac_lz_enc lz_enc;
+static uint8_t lz_src[768];
+static uint8_t lz_dst[768];
+static uint8_t lz_rx_buf[768];
+static xSemaphoreHandle lz_mutex;
+#endif
+
+#ifdef CFG_UMAC_SLIP
+#define BRIDGE_CAP_SLIP   (P_CAP_SLIP)
+#else
+#define BRIDGE_CAP_SLIP   (0)
+#endif
+#ifdef CFG_UMAC_LZ
+#define BRIDGE_CAP_LZ     (P_CAP_LZ)
+#else
+#define BRIDGE_CAP_LZ     (0)
+#endif
+#define BRIDGE_CAPS       (BRIDGE_CAP_SLIP | BRIDGE_CAP_LZ)
+
+// packets shorter than this are not worth compressing
+#define BRIDGE_LZ_MIN_LEN 64
 
 static void bridge_udp_recv_cb(int res, uint32_t ip, uint8_t *buf, uint16_t len);
+static void bridge_udp_unsubscribe_all(void);
+
+static void bridge_apply_caps(uint8_t caps) {
+  peer_caps = caps;
+#ifdef CFG_UMAC_SLIP
+  _impl_umac_set_framing((caps & P_CAP_SLIP) ? UMAC_FRAMING_SLIP : UMAC_FRAMING_RAW);
+#endif
+}
 
 void bridge_ping(void) {
   ping_val = hwrand();
@@ -41,50 +156,133 @@ void bridge_ping(void) {
       (ping_val >> 24),
       (ping_val >> 16),
       (ping_val >> 8),
-      (ping_val)
+      (ping_val),
+      BRIDGE_CAPS
   };
   bridge_tx_pkt(true, pkt, sizeof(pkt));
 }
 
+// append one pending lamp command to pkt, returns its length
+static uint8_t batch_item_pkt(batch_item item, uint8_t *pkt) {
+  switch (item) {
+  case BATCH_ENA:
+    pkt[0] = P_STM_LAMP_ENA;
+    pkt[1] = batch.ena;
+    return 2;
+  case BATCH_INTENSITY:
+    pkt[0] = P_STM_LAMP_INTENSITY;
+    pkt[1] = batch.intensity;
+    return 2;
+  case BATCH_COLOR:
+    pkt[0] = P_STM_LAMP_COLOR;
+    pkt[1] = batch.rgb >> 16;
+    pkt[2] = batch.rgb >> 8;
+    pkt[3] = batch.rgb;
+    return 4;
+  default:
+    return 0;
+  }
+}
+
+// send pending lamp commands, a single command as is, else as a batch,
+// under batch_mutex
+static void batch_flush_locked(void) {
+  uint8_t pkt[1 + _BATCH_ITEMS * (1 + 4)];
+  uint8_t len = 0;
+  uint8_t i;
+  if (batch.cnt == 1) {
+    len = batch_item_pkt(batch.order[0], pkt);
+  } else if (batch.cnt > 1) {
+    pkt[len++] = P_STM_BATCH;
+    for (i = 0; i < batch.cnt; i++) {
+      uint8_t ilen = batch_item_pkt(batch.order[i], &pkt[len + 1]);
+      pkt[len] = ilen;
+      len += 1 + ilen;
+    }
+  }
+  if (len > 0) {
+    if (bridge_tx_pkt(true, pkt, len) < 0) {
+      // window full, try again later
+      xTimerReset(batch_tim, 0);
+    } else {
+      batch.cnt = 0;
+    }
+  }
+}
+
+static void batch_flush(void) {
+  (void)xSemaphoreTake(batch_mutex, portMAX_DELAY);
+  batch_flush_locked();
+  (void)xSemaphoreGive(batch_mutex);
+}
+
+static void batch_tim_cb(xTimerHandle xTimer) {
+  // runs in the timer daemon, which also runs the umac tick, so never
+  // wait for a task holding the batch, try again a window later
+  if (xSemaphoreTake(batch_mutex, 0) != pdTRUE) {
+    xTimerReset(batch_tim, 0);
+    return;
+  }
+  batch_flush_locked();
+  (void)xSemaphoreGive(batch_mutex);
+}
+
+// update a pending lamp command, last writer wins
+static void batch_put(batch_item item, bool ena, uint8_t intensity, uint32_t rgb) {
+  uint8_t i;
+  (void)xSemaphoreTake(batch_mutex, portMAX_DELAY);
+  bool first = batch.cnt == 0;
+  for (i = 0; i < batch.cnt && batch.order[i] != item; i++);
+  if (i == batch.cnt) {
+    batch.order[batch.cnt++] = item;
+  }
+  switch (item) {
+  case BATCH_ENA: batch.ena = ena; break;
+  case BATCH_INTENSITY: batch.intensity = intensity; break;
+  case BATCH_COLOR: batch.rgb = rgb; break;
+  default: break;
+  }
+  if (first) {
+    xTimerReset(batch_tim, 0);
+  }
+  (void)xSemaphoreGive(batch_mutex);
+}
+
 void bridge_lamp_set_color(uint32_t rgb) {
-  uint8_t pkt[] = {
-      P_STM_LAMP_COLOR,
-      (rgb >> 16),
-      (rgb >> 8),
-      (rgb)
-  };
-  bridge_tx_pkt(true, pkt, sizeof(pkt));
+  batch_put(BATCH_COLOR, 0, 0, rgb);
 }
 
 void bridge_lamp_set_intensity(uint8_t i) {
-  uint8_t pkt[] = {
-      P_STM_LAMP_INTENSITY,
-      i
-  };
-  bridge_tx_pkt(true, pkt, sizeof(pkt));
+  batch_put(BATCH_INTENSITY, 0, i, 0);
 }
 
 void bridge_lamp_set_ena(bool ena) {
-  uint8_t pkt[] = {
-      P_STM_LAMP_ENA,
-      ena
-  };
-  bridge_tx_pkt(true, pkt, sizeof(pkt));
+  batch_put(BATCH_ENA, ena, 0, 0);
 }
 
 void bridge_lamp_set_status(bool ena, uint8_t intensity, uint32_t rgb) {
+  batch_put(BATCH_ENA, ena, 0, 0);
+  batch_put(BATCH_INTENSITY, 0, intensity, 0);
+  batch_put(BATCH_COLOR, 0, 0, rgb);
+}
+
+int bridge_lamp_set_fx(uint8_t fx, uint32_t period_ms, uint32_t rgb_a, uint32_t rgb_b) {
+  // let pending commands go first
+  xTimerStop(batch_tim, 0);
+  batch_flush();
   uint8_t pkt[] = {
-      P_STM_LAMP_STATUS,
-      ena,
-      intensity,
-      (rgb >> 16),
-      (rgb >> 8),
-      (rgb)
+      P_STM_LAMP_FX, fx,
+      period_ms >> 24, period_ms >> 16, period_ms >> 8, period_ms,
+      rgb_a >> 16, rgb_a >> 8, rgb_a,
+      rgb_b >> 16, rgb_b >> 8, rgb_b
   };
-  bridge_tx_pkt(true, pkt, sizeof(pkt));
+  return bridge_tx_pkt(true, pkt, sizeof(pkt));
 }
 
 int bridge_lamp_ask_status(void) {
+  // let pending commands go first
+  xTimerStop(batch_tim, 0);
+  batch_flush();
   uint8_t pkt[] = {
       P_STM_LAMP_GET_STATUS
   };
@@ -93,146 +291,336 @@ int bridge_lamp_ask_status(void) {
 
 lamp_status *bridge_lamp_get_status(bool refresh_syncronously) {
   if (refresh_syncronously) {
-    sync_seqno = bridge_lamp_ask_status();
-    if (sync_seqno > 0) {
-      uint32_t msg;
-      printf("sync recv pkt %i\n", sync_seqno);
-      xQueueReceive(syncq, &msg, 1000/portTICK_RATE_MS);
-    }
+    // let pending commands go first
+    xTimerStop(batch_tim, 0);
+    batch_flush();
+    uint8_t pkt[] = {
+        P_STM_LAMP_GET_STATUS
+    };
+    // lamp is updated when acked
+    (void)bridge_request(pkt, sizeof(pkt), NULL, 0, 1000/portTICK_RATE_MS);
   }
   return &lamp;
 }
 
 ///////////////////////////////////////////////////////////
 
-void bridge_pkt_acked(uint8_t seqno, uint8_t *data, uint16_t len) {
-  printf("ack pkt %i, cmd %02x, len %i\n", seqno, data[0], len);
-  if (len == 0) return;
-  switch (data[0]) {
-  case P_STM_HELLO: {
-    uint32_t ping_val_rcv =
-        (data[1]<<24) |
-        (data[2]<<16) |
-        (data[3]<<8) |
-        data[4];
-    if (ping_val == ping_val_rcv) {
-      printf("PONG ok\n");
+// sends a packet and claims a request entry for it, under um_mutex
+static bridge_req *bridge_req_issue(uint8_t *buf, uint16_t len) {
+  int i;
+  bridge_req *r = NULL;
+  for (i = 0; i < BRIDGE_MAX_REQUESTS; i++) {
+    if (!reqs[i].busy) {
+      r = &reqs[i];
+      break;
+    }
+  }
+  if (r == NULL) return NULL;
+  int seqno = bridge_tx_pkt(true, buf, len);
+  if (seqno <= 0) return NULL;
+  r->busy = true;
+  r->seqno = seqno;
+  r->gen = req_gen++;
+  r->res = -1;
+  return r;
+}
+
+// completes the oldest request awaiting given seqno, res < 0 on timeout,
+// called by umac under um_mutex, never blocks the timer daemon
+static void bridge_req_complete(uint8_t seqno, int res, uint8_t *data, uint16_t len) {
+  int i;
+  bridge_req *r = NULL;
+  for (i = 0; i < BRIDGE_MAX_REQUESTS; i++) {
+    if (reqs[i].busy && reqs[i].seqno == seqno && (r == NULL || (int32_t)(reqs[i].gen - r->gen) < 0)) {
+      r = &reqs[i];
+    }
+  }
+  if (r == NULL) return;
+  bridge_req_cb cb = r->cb;
+  void *arg = r->arg;
+  r->seqno = 0;
+  if (cb) {
+    r->busy = false;
+  } else {
+    if (res >= 0 && r->rsp) {
+      res = len < r->rsp_max ? len : r->rsp_max;
+      memcpy(r->rsp, data, res);
+    }
+    r->res = res;
+    (void)xSemaphoreGive(r->sem);
+  }
+  if (cb) {
+    cb(res, data, len, arg);
+  }
+}
+
+int bridge_request(uint8_t *buf, uint16_t len, uint8_t *rsp, uint16_t rsp_max,
+    uint32_t timeout) {
+  _impl_umac_lock();
+  bridge_req *r = bridge_req_issue(buf, len);
+  if (r == NULL) {
+    _impl_umac_unlock();
+    return -1;
+  }
+  r->cb = NULL;
+  r->rsp = rsp;
+  r->rsp_max = rsp_max;
+  _impl_umac_unlock();
+
+  bool done = xSemaphoreTake(r->sem, timeout) == pdTRUE;
+  _impl_umac_lock();
+  if (!done) {
+    if (r->seqno) {
+      // gave up waiting, ack is ignored if it comes
+      r->seqno = 0;
     } else {
-      printf("PONG bad\n");
+      // completed just after timeout
+      (void)xSemaphoreTake(r->sem, 0);
     }
-    break;
   }
-  case P_STM_LAMP_GET_ENA:
-    lamp.ena = data[1] != 0;
-    break;
-  case P_STM_LAMP_GET_INTENSITY:
-    lamp.intensity = data[1];
-    break;
-  case P_STM_LAMP_GET_COLOR:
-    lamp.rgb = (data[1] << 16) | (data[2] << 8) | (data[3]);
-    break;
-  case P_STM_LAMP_GET_STATUS:
-    lamp.ena = data[1] != 0;
-    lamp.intensity = data[2];
-    lamp.rgb = (data[3] << 16) | (data[4] << 8) | (data[5]);
-    printf("lamp ena:%i int:%i rgb:%06x\n", lamp.ena, lamp.intensity, lamp.rgb);
-    break;
+  int res = r->res;
+  r->busy = false;
+  _impl_umac_unlock();
+  return res;
+}
 
-  default:
-    break;
+int bridge_request_async(uint8_t *buf, uint16_t len, bridge_req_cb cb, void *arg) {
+  _impl_umac_lock();
+  bridge_req *r = bridge_req_issue(buf, len);
+  int seqno = -1;
+  if (r) {
+    r->cb = cb;
+    r->arg = arg;
+    seqno = r->seqno;
+  }
+  _impl_umac_unlock();
+  return seqno;
+}
+
+///////////////////////////////////////////////////////////
+
+// called by umac under um_mutex
+void bridge_pkt_acked(uint8_t seqno, uint8_t *data, uint16_t len) {
+  umac_frag_on_ack(&frag, seqno);
+  if (len > 0 && data[0] < _P_STM_CNT) {
+    bridge_handler *h = &ack_handlers[data[0]];
+    if (h->ack_fn && len >= h->min_len) {
+      uint32_t t0 = sdk_system_get_time();
+      h->ack_fn(seqno, data, len);
+      h->calls++;
+      h->us += sdk_system_get_time() - t0;
+    }
   }
+  bridge_req_complete(seqno, len, data, len);
+}
 
-  if (sync_seqno > 0 && sync_seqno == seqno) {
-    xQueueSend(syncq, &sync_seqno, 0);
-    printf("sync notify pkt %i\n", sync_seqno);
-    sync_seqno = 0;
+static void bridge_ack_hello(uint8_t seqno, uint8_t *data, uint16_t len) {
+  uint32_t ping_val_rcv =
+      (data[1]<<24) |
+      (data[2]<<16) |
+      (data[3]<<8) |
+      data[4];
+  if (ping_val == ping_val_rcv) {
+    printf("PONG ok\n");
+  } else {
+    printf("PONG bad\n");
   }
+  bridge_apply_caps(len >= 6 ? data[5] : 0);
+}
 
+static void bridge_ack_lamp_ena(uint8_t seqno, uint8_t *data, uint16_t len) {
+  lamp.ena = data[1] != 0;
+}
+
+static void bridge_ack_lamp_intensity(uint8_t seqno, uint8_t *data, uint16_t len) {
+  lamp.intensity = data[1];
+}
+
+static void bridge_ack_lamp_color(uint8_t seqno, uint8_t *data, uint16_t len) {
+  lamp.rgb = (data[1] << 16) | (data[2] << 8) | (data[3]);
+}
+
+static void bridge_ack_lamp_status(uint8_t seqno, uint8_t *data, uint16_t len) {
+  lamp.ena = data[1] != 0;
+  lamp.intensity = data[2];
+  lamp.rgb = (data[3] << 16) | (data[4] << 8) | (data[5]);
 }
 
 ///////////////////////////////////////////////////////////
 
+static void bridge_dispatch_rx(uint8_t *data, uint16_t len, bool resent) {
+  if (len == 0) return;
+  uint8_t id = data[0];
+  bridge_handler *h = id < _P_ESP_CNT ? &rx_handlers[id] : NULL;
+  if (h == NULL || h->rx_fn == NULL) {
+    printf("unhandled pkt %02x\n", id);
+    return;
+  }
+  if (len < h->min_len) {
+    printf("short pkt %02x, %i bytes\n", id, len);
+    return;
+  }
+  uint32_t t0 = sdk_system_get_time();
+  h->rx_fn(data, len, resent);
+  h->calls++;
+  h->us += sdk_system_get_time() - t0;
+}
+
 void bridge_rx_pkt(umac_pkt *pkt, bool resent) {
-  printf("rx pkt %i, cmd %02x, len %i\n", pkt->seqno, pkt->data[0], pkt->length);
-  if (pkt->length == 0) return;
-  uint8_t *data = pkt->data;
-  switch(data[0]) {
-  case P_ESP_HELLO:
-    bridge_tx_reply(data, pkt->length);
-  break;
-  case P_ESP_AP_SCAN:
-    if (resent) break;
-    systask_call(SYS_WIFI_SCAN_DBG, false);
-  break;
-  case P_ESP_SEND_UDP:
-    if (resent) break;
-    udputil_config(
-        (data[1] << 24) | (data[2] << 16) | (data[3] << 8) | data[4], // ip
-        (data[5] << 8) | (data[6]),                                   // port
-        0,                                                            // timeout
-        &data[7],                                                     // txdata
-        pkt->length - 8,                                              // len,
-        NULL,                                                         // rxdata
-        NULL                                                          // recv_cb
-      );
-    systask_call(SYS_UDP_SEND, false);
-  break;
-  case P_ESP_RECV_UDP:
-    if (resent) break;
-    udputil_config(
-        (data[1] << 24) | (data[2] << 16) | (data[3] << 8) | data[4], // ip
-        (data[5] << 8) | (data[6]),                                   // port
-        (data[7] << 8) | (data[8]),                                   // timeout
-        NULL,                                                         // txdata
-        0,                                                            // len,
-        udp_rx.udp_rx_buf,                                            // rxdata
-        bridge_udp_recv_cb                                            // recv_cb
-      );
-    systask_call(SYS_UDP_RECV, false);
-  break;
-  case P_ESP_SEND_RECV_UDP:
-    if (resent) break;
-    udputil_config(
-        (data[1] << 24) | (data[2] << 16) | (data[3] << 8) | data[4], // ip
-        (data[5] << 8) | (data[6]),                                   // port
-        (data[7] << 8) | (data[8]),                                   // timeout
-        &data[9],                                                     // txdata
-        pkt->length - 10,                                             // len,
-        udp_rx.udp_rx_buf,                                            // rxdata
-        bridge_udp_recv_cb                                            // recv_cb
-      );
-    systask_call(SYS_UDP_SEND_RECV, false);
-    break;
-  case P_ESP_AP_CFG:
-    if (resent) break;
-    uint32_t ssid_len = data[1];
-    uint32_t pass_len = data[1 + ssid_len + 1];
-    uint8_t *ssid = &data[2];
-    uint8_t *pass = &data[1 + ssid_len + 1 + 1];
-    {
-      uint8_t nl = '\n';
-      fs_clearerr();
-      spiffs_file fd = fs_open(".ssid", SPIFFS_O_CREAT | SPIFFS_O_TRUNC | SPIFFS_O_WRONLY, 0);
-      if (fd >= 0) {
-        fs_write(fd, ssid, ssid_len);
-        fs_write(fd, &nl, 1);
-        fs_write(fd, pass, pass_len);
-        fs_write(fd, &nl, 1);
-        fs_close(fd);
-      } else {
-        printf("could not create credential file\n");
-      }
-      printf("fs res: %i\n", fs_errno());
-    }
-  break;
+  bridge_dispatch_rx(pkt->data, pkt->length, resent);
+}
+
+static void bridge_rx_hello(uint8_t *data, uint16_t len, bool resent) {
+  uint8_t caps = 0;
+  if (len >= 6) {
+    caps = data[5] & BRIDGE_CAPS;
+    data[5] = caps;
+  }
+  bridge_tx_reply(data, len);
+  bridge_apply_caps(caps);
+  // stm might have restarted, forget its subscriptions
+  if (!resent) bridge_udp_unsubscribe_all();
+}
+
+static void bridge_rx_ap_scan(uint8_t *data, uint16_t len, bool resent) {
+  if (resent) return;
+  systask_call(SYS_WIFI_SCAN_DBG, false);
+}
+
+static void bridge_rx_send_udp(uint8_t *data, uint16_t len, bool resent) {
+  if (resent) return;
+  udputil_config(
+      (data[1] << 24) | (data[2] << 16) | (data[3] << 8) | data[4], // ip
+      (data[5] << 8) | (data[6]),                                   // port
+      0,                                                            // timeout
+      &data[7],                                                     // txdata
+      len - 8,                                                      // len,
+      NULL,                                                         // rxdata
+      NULL                                                          // recv_cb
+    );
+  systask_call(SYS_UDP_SEND, false);
+}
+
+static void bridge_rx_recv_udp(uint8_t *data, uint16_t len, bool resent) {
+  if (resent) return;
+  udputil_config(
+      (data[1] << 24) | (data[2] << 16) | (data[3] << 8) | data[4], // ip
+      (data[5] << 8) | (data[6]),                                   // port
+      (data[7] << 8) | (data[8]),                                   // timeout
+      NULL,                                                         // txdata
+      0,                                                            // len,
+      udp_rx_buf,                                                   // rxdata
+      bridge_udp_recv_cb                                            // recv_cb
+    );
+  systask_call(SYS_UDP_RECV, false);
+}
+
+static void bridge_rx_send_recv_udp(uint8_t *data, uint16_t len, bool resent) {
+  if (resent) return;
+  udputil_config(
+      (data[1] << 24) | (data[2] << 16) | (data[3] << 8) | data[4], // ip
+      (data[5] << 8) | (data[6]),                                   // port
+      (data[7] << 8) | (data[8]),                                   // timeout
+      &data[9],                                                     // txdata
+      len - 10,                                                     // len,
+      udp_rx_buf,                                                   // rxdata
+      bridge_udp_recv_cb                                            // recv_cb
+    );
+  systask_call(SYS_UDP_SEND_RECV, false);
+}
+
+static void bridge_rx_udp_subscribe(uint8_t *data, uint16_t len, bool resent) {
+  uint16_t port = (data[1] << 8) | data[2];
+  int res = bridge_udp_subscribe(port);
+  uint8_t rsp[4] = {P_ESP_UDP_SUBSCRIBE, data[1], data[2], res < 0 ? 1 : 0};
+  bridge_tx_reply(rsp, sizeof(rsp));
+}
+
+static void bridge_rx_udp_unsubscribe(uint8_t *data, uint16_t len, bool resent) {
+  bridge_udp_unsubscribe((data[1] << 8) | data[2]);
+}
+
+static void bridge_rx_lamp_status(uint8_t *data, uint16_t len, bool resent) {
+  lamp.ena = data[1] != 0;
+  lamp.intensity = data[2];
+  lamp.rgb = (data[3] << 16) | (data[4] << 8) | (data[5]);
+}
+
+// containers never nest, anything else would let a peer recurse the stack
+static bool bridge_is_container(uint8_t id) {
+  return id == P_ESP_FRAG || id == P_ESP_LZ;
+}
+
+static void bridge_rx_frag(uint8_t *data, uint16_t len, bool resent) {
+  // duplicates are sorted out by reassembly
+  umac_frag_rx(&frag, &data[1], len - 1);
+}
+
+#ifdef CFG_UMAC_LZ
+static void bridge_rx_lz(uint8_t *data, uint16_t len, bool resent) {
+  int lz_len = umac_lz_decompress(&data[1], len - 1, lz_rx_buf, sizeof(lz_rx_buf));
+  if (lz_len <= 0 || bridge_is_container(lz_rx_buf[0])) {
+    printf("bad lz pkt\n");
+    return;
+  }
+  bridge_dispatch_rx(lz_rx_buf, lz_len, resent);
+}
+#endif
 
+static void bridge_rx_ap_cfg(uint8_t *data, uint16_t len, bool resent) {
+  if (resent) return;
+  uint32_t ssid_len = data[1];
+  if (2 + ssid_len >= len) return;
+  uint32_t pass_len = data[1 + ssid_len + 1];
+  uint8_t *ssid = &data[2];
+  uint8_t *pass = &data[1 + ssid_len + 1 + 1];
+  uint8_t nl = '\n';
+  fs_clearerr();
+  spiffs_file fd = fs_open(".ssid", SPIFFS_O_CREAT | SPIFFS_O_TRUNC | SPIFFS_O_WRONLY, 0);
+  if (fd >= 0) {
+    fs_write(fd, ssid, ssid_len);
+    fs_write(fd, &nl, 1);
+    fs_write(fd, pass, pass_len);
+    fs_write(fd, &nl, 1);
+    fs_close(fd);
+  } else {
+    printf("could not create credential file\n");
+  }
+  printf("fs res: %i\n", fs_errno());
+}
+
+void bridge_register_rx(uint8_t id, uint16_t min_len, bridge_rx_fn fn) {
+  if (id >= _P_ESP_CNT) return;
+  rx_handlers[id].rx_fn = fn;
+  rx_handlers[id].min_len = min_len;
+}
+
+void bridge_register_ack(uint8_t id, uint16_t min_len, bridge_ack_fn fn) {
+  if (id >= _P_STM_CNT) return;
+  ack_handlers[id].ack_fn = fn;
+  ack_handlers[id].min_len = min_len;
+}
 
+void bridge_get_prof(bridge_prof *rx, bridge_prof *ack, bool reset) {
+  int i;
+  for (i = 0; i < _P_ESP_CNT; i++) {
+    rx[i].calls = rx_handlers[i].calls;
+    rx[i].us = rx_handlers[i].us;
+    if (reset) rx_handlers[i].calls = rx_handlers[i].us = 0;
+  }
+  for (i = 0; i < _P_STM_CNT; i++) {
+    ack[i].calls = ack_handlers[i].calls;
+    ack[i].us = ack_handlers[i].us;
+    if (reset) ack_handlers[i].calls = ack_handlers[i].us = 0;
   }
 }
 
 ///////////////////////////////////////////////////////////
 
+// called by umac under um_mutex
 void bridge_timeout(umac_pkt *pkt) {
+  if (umac_frag_on_timeout(&frag, pkt->seqno)) return;
+  bridge_req_complete(pkt->seqno, -1, NULL, 0);
   if (pkt->length == 0) return;
   uint8_t *data = pkt->data;
   switch(data[0]) {
@@ -248,23 +636,269 @@ int bridge_tx_pkt(uint8_t ack, uint8_t *buf, uint16_t len) {
   return _impl_umac_tx_pkt(ack, buf, len);
 }
 
+int bridge_tx_pktv(uint8_t ack, const umac_seg *segs, uint8_t nsegs) {
+  return _impl_umac_tx_pktv(ack, segs, nsegs);
+}
+
+int bridge_tx_bulk_pktv(uint8_t ack, const umac_seg *segs, uint8_t nsegs) {
+  return _impl_umac_tx_bulk_pktv(ack, segs, nsegs);
+}
+
+int bridge_try_tx_bulk_pktv(uint8_t ack, const umac_seg *segs, uint8_t nsegs) {
+  return _impl_umac_try_tx_bulk_pktv(ack, segs, nsegs);
+}
+
+int bridge_tx_bulk_lz(const umac_seg *segs, uint8_t nsegs) {
+#ifdef CFG_UMAC_LZ
+  if (peer_caps & P_CAP_LZ) {
+    (void)xSemaphoreTake(lz_mutex, portMAX_DELAY);
+    uint16_t len = 0;
+    uint8_t i;
+    for (i = 0; i < nsegs && len + segs[i].len <= sizeof(lz_src); i++) {
+      memcpy(&lz_src[len], segs[i].data, segs[i].len);
+      len += segs[i].len;
+    }
+    int clen = -1;
+    if (i == nsegs && len >= BRIDGE_LZ_MIN_LEN) {
+      // give up unless at least two bytes are saved, including container id
+      clen = umac_lz_compress(&lz_enc, lz_src, len, &lz_dst[1], len - 3);
+    }
+    int res;
+    if (clen > 0) {
+      lz_dst[0] = P_STM_LZ;
+      umac_seg seg = { .data = lz_dst, .len = clen + 1 };
+      res = bridge_tx_bulk_pktv(false, &seg, 1);
+    } else {
+      res = bridge_tx_bulk_pktv(false, segs, nsegs);
+    }
+    (void)xSemaphoreGive(lz_mutex);
+    return res;
+  }
+#endif
+  return bridge_tx_bulk_pktv(false, segs, nsegs);
+}
+
+int bridge_tx_msg(uint8_t *buf, uint16_t len) {
+  if (len <= UMAC_MAX_LEN) {
+    return bridge_tx_pkt(true, buf, len);
+  }
+  // fragment state is also updated on acks and timeouts, under um_mutex
+  _impl_umac_lock();
+  int res = umac_frag_tx(&frag, buf, len);
+  _impl_umac_unlock();
+  return res;
+}
+
 void bridge_tx_reply(uint8_t *buf, uint16_t len) {
   (void)_impl_umac_reply_pkt(buf, len);
 }
 
+static void bridge_frag_tx_done(uint8_t msgid, int res) {
+  frag_done_msgid = msgid;
+  frag_done_res = res;
+  (void)xSemaphoreGive(frag_done_sem);
+}
+
+// sends a fragmented message and blocks until it is acked or failed, so
+// buf may be reused on return
+static int bridge_tx_msg_wait(uint8_t *buf, uint16_t len) {
+  (void)xSemaphoreTake(frag_done_sem, 0);
+  _impl_umac_lock();
+  int msgid = umac_frag_tx(&frag, buf, len);
+  _impl_umac_unlock();
+  if (msgid < 0) return -1;
+  // only one message is sent at a time, a stale give has another msgid
+  while (1) {
+    (void)xSemaphoreTake(frag_done_sem, portMAX_DELAY);
+    if (frag_done_msgid == msgid) return frag_done_res;
+  }
+}
+
+static int bridge_frag_tx(const umac_seg *segs, uint8_t nsegs) {
+  return bridge_tx_pktv(true, segs, nsegs);
+}
+
+static void bridge_frag_rx_msg(uint8_t *data, uint16_t len) {
+  if (len == 0 || bridge_is_container(data[0])) return;
+  bridge_dispatch_rx(data, len, false);
+}
+
+static void bridge_udp_sub_cb(uint32_t ip, uint16_t src_port, uint8_t *buf, uint16_t len, void *arg) {
+  udp_stats.rx++;
+  if (len > UDPUTIL_LISTEN_MAX_LEN) {
+    udp_stats.long_drops++;
+    return;
+  }
+  udp_sub_rx.ip = ip;
+  udp_sub_rx.src_port = src_port;
+  udp_sub_rx.len = len;
+  memcpy(&udp_sub_rx.pkt[BRIDGE_UDP_HDR_LEN], buf, len);
+  // never block the listener, it would only move the drops into lwip
+  if (xQueueSend(udp_sub_q, &udp_sub_rx, 0) != pdTRUE) {
+    udp_stats.queue_drops++;
+  }
+}
+
+static void bridge_udp_fwd_task(void *pvParameters) {
+  while (1) {
+    if (!xQueueReceive(udp_sub_q, &udp_sub_fwd, portMAX_DELAY)) continue;
+    uint32_t drops = udp_stats.queue_drops + udp_stats.tx_drops - udp_drops_told;
+    udp_drops_told += drops;
+    uint8_t *pkt = udp_sub_fwd.pkt;
+    pkt[0] = P_STM_UDP_DATA;
+    pkt[1] = udp_sub_fwd.ip >> 24;
+    pkt[2] = udp_sub_fwd.ip >> 16;
+    pkt[3] = udp_sub_fwd.ip >> 8;
+    pkt[4] = udp_sub_fwd.ip;
+    pkt[5] = udp_sub_fwd.src_port >> 8;
+    pkt[6] = udp_sub_fwd.src_port;
+    pkt[7] = drops > 255 ? 255 : drops;
+    uint16_t len = BRIDGE_UDP_HDR_LEN + udp_sub_fwd.len;
+    int res;
+    if (len <= UMAC_MAX_LEN) {
+      umac_seg seg = { .data = pkt, .len = len };
+      res = bridge_tx_bulk_lz(&seg, 1);
+    } else {
+      res = bridge_tx_msg_wait(pkt, len);
+    }
+    if (res < 0) {
+      udp_stats.tx_drops++;
+    } else {
+      udp_stats.relayed++;
+    }
+  }
+}
+
+int bridge_udp_subscribe(uint16_t port) {
+  int i;
+  int free_ix = -1;
+  for (i = 0; i < UDPUTIL_MAX_LISTENERS; i++) {
+    if (udp_sub_ports[i] == port) return 0;
+    if (udp_sub_ports[i] == 0 && free_ix < 0) free_ix = i;
+  }
+  if (port == 0 || free_ix < 0) return -1;
+  int res = udputil_listen(port, bridge_udp_sub_cb, NULL);
+  if (res >= 0) udp_sub_ports[free_ix] = port;
+  return res;
+}
+
+void bridge_udp_unsubscribe(uint16_t port) {
+  int i;
+  bool any = false;
+  for (i = 0; i < UDPUTIL_MAX_LISTENERS; i++) {
+    if (udp_sub_ports[i] == port) {
+      udputil_unlisten(port, bridge_udp_sub_cb);
+      udp_sub_ports[i] = 0;
+    }
+    any |= udp_sub_ports[i] != 0;
+  }
+  if (!any) xQueueReset(udp_sub_q);
+}
+
+static void bridge_udp_unsubscribe_all(void) {
+  int i;
+  for (i = 0; i < UDPUTIL_MAX_LISTENERS; i++) {
+    if (udp_sub_ports[i]) bridge_udp_unsubscribe(udp_sub_ports[i]);
+  }
+}
+
+int bridge_lamp_frame(const uint8_t *rgb, uint16_t leds) {
+  frame_seq++;
+  uint16_t first = 0;
+  int res = 0;
+  do {
+    uint16_t n = leds - first;
+    if (n > BRIDGE_FRAME_PKT_LEDS) n = BRIDGE_FRAME_PKT_LEDS;
+    frame_hdr[0] = P_STM_LAMP_FRAME;
+    frame_hdr[1] = frame_seq;
+    frame_hdr[2] = first + n >= leds ? P_FRAME_SHOW : 0;
+    frame_hdr[3] = first >> 8;
+    frame_hdr[4] = first;
+    umac_seg segs[] = {
+        { .data = frame_hdr, .len = sizeof(frame_hdr) },
+        { .data = (uint8_t *)&rgb[first * 3], .len = n * 3 }
+    };
+    if (first == 0) {
+      // skip the frame rather than queue it if the bulk lane is busy, once
+      // started the rest of it waits its turn
+      res = bridge_try_tx_bulk_pktv(false, segs, 2);
+    } else {
+      res = bridge_tx_bulk_pktv(false, segs, 2);
+    }
+    first += n;
+  } while (res >= 0 && first < leds);
+  return res;
+}
+
+void bridge_get_udp_stats(bridge_udp_stats *dst, bool reset) {
+  memcpy(dst, &udp_stats, sizeof(bridge_udp_stats));
+  if (reset) {
+    memset(&udp_stats, 0, sizeof(bridge_udp_stats));
+    udp_drops_told = 0;
+  }
+}
+
 void bridge_init(void) {
-  syncq = xQueueCreate(1, sizeof(uint32_t));
-  sync_seqno = -1;
+  int i;
+  for (i = 0; i < BRIDGE_MAX_REQUESTS; i++) {
+    vSemaphoreCreateBinary(reqs[i].sem);
+    (void)xSemaphoreTake(reqs[i].sem, 0);
+  }
+  batch_mutex = xSemaphoreCreateMutex();
+  batch_tim = xTimerCreate(
+      (signed char *)"batch_tim",
+      BRIDGE_BATCH_WINDOW,
+      false,
+      NULL, batch_tim_cb);
+#ifdef CFG_UMAC_LZ
+  lz_mutex = xSemaphoreCreateMutex();
+#endif
+  umac_frag_cfg frag_cfg = {
+      .tx_fn = bridge_frag_tx,
+      .rx_msg_fn = bridge_frag_rx_msg,
+      .tx_done_fn = bridge_frag_tx_done,
+      .container_id = P_STM_FRAG
+  };
+  vSemaphoreCreateBinary(frag_done_sem);
+  (void)xSemaphoreTake(frag_done_sem, 0);
+  umac_frag_init(&frag, &frag_cfg);
+
+  udp_sub_q = xQueueCreate(BRIDGE_UDP_QUEUE_LEN, sizeof(bridge_udp_dgram));
+  xTaskCreate(bridge_udp_fwd_task, (signed char *)"udp_fwd", 384, NULL, 2, NULL);
+
+  bridge_register_rx(P_ESP_HELLO, 5, bridge_rx_hello);
+  bridge_register_rx(P_ESP_SEND_UDP, 8, bridge_rx_send_udp);
+  bridge_register_rx(P_ESP_RECV_UDP, 9, bridge_rx_recv_udp);
+  bridge_register_rx(P_ESP_SEND_RECV_UDP, 10, bridge_rx_send_recv_udp);
+  bridge_register_rx(P_ESP_AP_SCAN, 1, bridge_rx_ap_scan);
+  bridge_register_rx(P_ESP_AP_CFG, 3, bridge_rx_ap_cfg);
+  bridge_register_rx(P_ESP_FRAG, UMAC_FRAG_HDR_LEN, bridge_rx_frag);
+#ifdef CFG_UMAC_LZ
+  bridge_register_rx(P_ESP_LZ, 2, bridge_rx_lz);
+#endif
+  bridge_register_rx(P_ESP_LAMP_STATUS, 6, bridge_rx_lamp_status);
+  bridge_register_rx(P_ESP_UDP_SUBSCRIBE, 3, bridge_rx_udp_subscribe);
+  bridge_register_rx(P_ESP_UDP_UNSUBSCRIBE, 3, bridge_rx_udp_unsubscribe);
+
+  bridge_register_ack(P_STM_HELLO, 5, bridge_ack_hello);
+  bridge_register_ack(P_STM_LAMP_GET_ENA, 2, bridge_ack_lamp_ena);
+  bridge_register_ack(P_STM_LAMP_GET_INTENSITY, 2, bridge_ack_lamp_intensity);
+  bridge_register_ack(P_STM_LAMP_GET_COLOR, 4, bridge_ack_lamp_color);
+  bridge_register_ack(P_STM_LAMP_GET_STATUS, 6, bridge_ack_lamp_status);
 }
 
 ///////////////////////////////////////////////////////////
 
 static void bridge_udp_recv_cb(int res, uint32_t ip, uint8_t *buf, uint16_t len) {
   if (res < 0) return;
-  udp_rx.udp_pkt_preamble[0] = P_STM_RECV_UDP;
-  udp_rx.udp_pkt_preamble[1] = ip >> 24;
-  udp_rx.udp_pkt_preamble[2] = ip >> 16;
-  udp_rx.udp_pkt_preamble[3] = ip >> 8;
-  udp_rx.udp_pkt_preamble[4] = ip;
-  bridge_tx_pkt(false, (uint8_t *)&udp_rx, len+sizeof(udp_rx.udp_pkt_preamble));
+  udp_pkt_preamble[0] = P_STM_RECV_UDP;
+  udp_pkt_preamble[1] = ip >> 24;
+  udp_pkt_preamble[2] = ip >> 16;
+  udp_pkt_preamble[3] = ip >> 8;
+  udp_pkt_preamble[4] = ip;
+  umac_seg segs[] = {
+      { .data = udp_pkt_preamble, .len = sizeof(udp_pkt_preamble) },
+      { .data = buf, .len = len }
+  };
+  bridge_tx_bulk_lz(segs, 2);
 }
@@ -20,14 +20,60 @@ typedef struct {
   volatile uint32_t rgb;
 } lamp_status;
 
+/* Called when a request is acked, res is the length of the ack payload in
+   data, or negative on timeout. */
+typedef void (* bridge_req_cb)(int res, uint8_t *data, uint16_t len, void *arg);
+
+typedef void (* bridge_rx_fn)(uint8_t *data, uint16_t len, bool resent);
+typedef void (* bridge_ack_fn)(uint8_t seqno, uint8_t *data, uint16_t len);
+
+typedef struct {
+  uint32_t calls;
+  uint32_t us;
+} bridge_prof;
+
+typedef struct {
+  uint32_t rx;            // datagrams received on subscribed ports
+  uint32_t relayed;       // datagrams sent to stm
+  uint32_t queue_drops;   // dropped as relay queue was full
+  uint32_t tx_drops;      // dropped as uart stayed busy
+  uint32_t long_drops;    // dropped as too long for relay
+} bridge_udp_stats;
+
 void bridge_init(void);
 
+/* Registers handler for packets from the stm with given id, see proto_efm.
+   Packets shorter than min_len are dropped. */
+void bridge_register_rx(uint8_t id, uint16_t min_len, bridge_rx_fn fn);
+/* Registers handler for acks carrying data for packets sent to the stm with
+   given id, see proto_stm. Shorter acks are ignored. */
+void bridge_register_ack(uint8_t id, uint16_t min_len, bridge_ack_fn fn);
+/* Copies number of calls and time spent per packet id, rx must hold
+   _P_ESP_CNT entries and ack _P_STM_CNT entries */
+void bridge_get_prof(bridge_prof *rx, bridge_prof *ack, bool reset);
+
+/* Relays every datagram received on port to the stm as P_STM_UDP_DATA,
+   until unsubscribed. Returns negative on error. */
+int bridge_udp_subscribe(uint16_t port);
+void bridge_udp_unsubscribe(uint16_t port);
+void bridge_get_udp_stats(bridge_udp_stats *dst, bool reset);
+
+/* Sends an rgb frame to the lamp on the bulk lane, split in
+   P_STM_LAMP_FRAME packets. Returns negative without sending anything if
+   the bulk lane is busy. */
+int bridge_lamp_frame(const uint8_t *rgb, uint16_t leds);
+
 void bridge_ping(void);
 void bridge_lamp_set_ena(bool ena);
 void bridge_lamp_set_intensity(uint8_t i);
 void bridge_lamp_set_color(uint32_t rgb);
 void bridge_lamp_set_status(bool ena, uint8_t intensity, uint32_t rgb);
+/* Starts lamp effect, see lamp_fx.h. Zero period or colors give defaults,
+   effect 0 stops. */
+int bridge_lamp_set_fx(uint8_t fx, uint32_t period_ms, uint32_t rgb_a, uint32_t rgb_b);
 int bridge_lamp_ask_status(void);
+/* Returns lamp status as last pushed by the stm. If refresh_syncronously,
+   the status is asked for first and the call blocks until answered. */
 lamp_status *bridge_lamp_get_status(bool refresh_syncronously);
 
 void bridge_rx_pkt(umac_pkt *pkt, bool resent);
@@ -38,9 +84,51 @@ void bridge_timeout(umac_pkt *pkt);
 
 int bridge_tx_pkt(uint8_t ack, uint8_t *buf, uint16_t len);
 
+int bridge_tx_pktv(uint8_t ack, const umac_seg *segs, uint8_t nsegs);
+
+/* Sends a bulk packet, which gives way to packets sent with
+   bridge_tx_pkt(v). Blocks while the uart is busy. */
+int bridge_tx_bulk_pktv(uint8_t ack, const umac_seg *segs, uint8_t nsegs);
+
+/* As bridge_tx_bulk_pktv, but returns UMAC_ERR_BULK_BUSY at once instead
+   of blocking while the uart is busy. */
+int bridge_try_tx_bulk_pktv(uint8_t ack, const umac_seg *segs, uint8_t nsegs);
+
+/* Sends an unsynchronized bulk packet, compressed if the other side
+   accepts it and it pays off. */
+int bridge_tx_bulk_lz(const umac_seg *segs, uint8_t nsegs);
+
+/* Sends a synchronized message, fragmented if longer than a umac packet.
+   The buffer must be kept until acked or timed out. */
+int bridge_tx_msg(uint8_t *buf, uint16_t len);
+
+/* Sends a synchronized packet and blocks until it is acked or timeout ticks
+   passed. Up to rsp_max bytes of the ack payload are copied to rsp. Returns
+   number of bytes copied, or negative on timeout or error. Any number of
+   tasks may wait for requests at the same time. */
+int bridge_request(uint8_t *buf, uint16_t len, uint8_t *rsp, uint16_t rsp_max,
+    uint32_t timeout);
+/* Sends a synchronized packet, cb is called from uart or timer task when it
+   is acked or timed out. Returns seqno, or negative on error. */
+int bridge_request_async(uint8_t *buf, uint16_t len, bridge_req_cb cb, void *arg);
+
 void bridge_tx_reply(uint8_t *buf, uint16_t len);
 
 int _impl_umac_tx_pkt(uint8_t ack, uint8_t *buf, uint16_t len);
+int _impl_umac_tx_pktv(uint8_t ack, const umac_seg *segs, uint8_t nsegs);
+int _impl_umac_tx_bulk_pktv(uint8_t ack, const umac_seg *segs, uint8_t nsegs);
+int _impl_umac_try_tx_bulk_pktv(uint8_t ack, const umac_seg *segs, uint8_t nsegs);
 int _impl_umac_reply_pkt(uint8_t *buf, uint16_t len);
+uint32_t _impl_umac_tx_pending(void);
+/* Serializes all umac use, recursive. Held while umac calls back into the
+   bridge, on received packets, acks and timeouts. */
+void _impl_umac_lock(void);
+void _impl_umac_unlock(void);
+#ifdef CFG_UMAC_SLIP
+void _impl_umac_set_framing(umac_framing framing);
+#endif
+#ifdef CFG_UMAC_STATS
+void _impl_umac_get_stats(umac_stats *dst, bool reset);
+#endif
 
 #endif /* _BRIDGE_H_ */
@@ -0,0 +1,109 @@
+/*
+ * ddp.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+/*
+ * Distributed Display Protocol, as sent by most led controller software.
+ *
+ * [flags][seq][type][id][offs:3][offs:2][offs:1][offs:0][len_h][len_l]([time:4])<data>
+ *
+ * flags: VV-T SRQP, VV version 01, T timecode present, S storage,
+ *        R reply, Q query, P push - display what has been received
+ * offs:  byte offset of data in frame
+ *
+ * Only rgb data to the default display is handled. Frames may be split over
+ * several packets, the last one having the push flag.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdio.h>
+#include "espressif/esp_common.h"
+#include "ddp.h"
+#include "udputil.h"
+#include "bridge_esp.h"
+
+#define DDP_HDR_LEN         10
+#define DDP_TIMECODE_LEN    4
+
+#define DDP_FLAG_VER_MASK   0xc0
+#define DDP_FLAG_VER1       0x40
+#define DDP_FLAG_TIMECODE   0x10
+#define DDP_FLAG_STORAGE    0x08
+#define DDP_FLAG_REPLY      0x04
+#define DDP_FLAG_QUERY      0x02
+#define DDP_FLAG_PUSH       0x01
+
+#define DDP_TYPE_UNDEF      0x00
+#define DDP_TYPE_RGB8       0x0b
+
+#define DDP_ID_DISPLAY      1
+#define DDP_ID_ALL          255
+
+static uint8_t frame[DDP_MAX_LEDS * 3];
+static uint16_t frame_len;
+static uint32_t frame_t0;
+static bool frame_started;
+static ddp_stats stats;
+
+static void ddp_recv_cb(uint32_t ip, uint16_t src_port, uint8_t *buf, uint16_t len, void *arg) {
+  stats.rx_pkts++;
+  if (len < DDP_HDR_LEN) {
+    stats.bad_pkts++;
+    return;
+  }
+  uint8_t flags = buf[0];
+  uint8_t type = buf[2];
+  uint8_t id = buf[3];
+  uint32_t offs = (buf[4] << 24) | (buf[5] << 16) | (buf[6] << 8) | buf[7];
+  uint16_t dlen = (buf[8] << 8) | buf[9];
+  uint16_t hlen = DDP_HDR_LEN + ((flags & DDP_FLAG_TIMECODE) ? DDP_TIMECODE_LEN : 0);
+  if ((flags & DDP_FLAG_VER_MASK) != DDP_FLAG_VER1 ||
+      (flags & (DDP_FLAG_QUERY | DDP_FLAG_REPLY | DDP_FLAG_STORAGE)) ||
+      (type != DDP_TYPE_UNDEF && type != DDP_TYPE_RGB8) ||
+      (id != DDP_ID_DISPLAY && id != DDP_ID_ALL) ||
+      hlen + dlen > len) {
+    stats.bad_pkts++;
+    return;
+  }
+
+  if (!frame_started) {
+    frame_started = true;
+    frame_t0 = sdk_system_get_time();
+  }
+  if (offs < sizeof(frame)) {
+    uint16_t n = dlen;
+    if (offs + n > sizeof(frame)) n = sizeof(frame) - offs;
+    memcpy(&frame[offs], &buf[hlen], n);
+    if (offs + n > frame_len) frame_len = offs + n;
+  }
+  if ((flags & DDP_FLAG_PUSH) == 0) return;
+
+  stats.frames++;
+  int res = bridge_lamp_frame(frame, frame_len / 3);
+  // next frame starts over, also if this one was dropped
+  frame_started = false;
+  frame_len = 0;
+  if (res < 0) {
+    // a newer frame will be along shortly, do not queue this one
+    stats.drops++;
+    return;
+  }
+  stats.relayed++;
+  uint32_t lat = sdk_system_get_time() - frame_t0;
+  stats.lat_us_sum += lat;
+  if (lat > stats.lat_us_max) stats.lat_us_max = lat;
+}
+
+int ddp_init(void) {
+  return udputil_listen(DDP_PORT, ddp_recv_cb, NULL);
+}
+
+void ddp_get_stats(ddp_stats *dst, bool reset) {
+  memcpy(dst, &stats, sizeof(ddp_stats));
+  if (reset) memset(&stats, 0, sizeof(ddp_stats));
+}
@@ -0,0 +1,33 @@
+/*
+ * ddp.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#ifndef _ESP8266_DDP_H_
+#define _ESP8266_DDP_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define DDP_PORT            4048
+// leds kept for a frame, data beyond this is ignored
+#define DDP_MAX_LEDS        300
+
+typedef struct {
+  uint32_t rx_pkts;       // ddp packets received
+  uint32_t bad_pkts;      // not rgb data for us
+  uint32_t frames;        // pushed frames
+  uint32_t relayed;       // frames sent to stm
+  uint32_t drops;         // frames skipped as uart was busy
+  uint32_t lat_us_max;    // from first packet of frame until relayed
+  uint32_t lat_us_sum;
+} ddp_stats;
+
+/* Starts listening for DDP rgb frames, which are relayed to the stm as
+   P_STM_LAMP_FRAME when pushed */
+int ddp_init(void);
+void ddp_get_stats(ddp_stats *dst, bool reset);
+
+#endif /* _ESP8266_DDP_H_ */
@@ -22,48 +22,162 @@
 #include "../umac/umac.h"
 #include "bridge_esp.h"
 #include "systasks.h"
+#include "uartio.h"
 
 #include "esp/hwrand.h"
+#include "stdout_redirect.h"
 
 
 uint32_t device_id;
 static umac um;
 static unsigned char rx_buf[768];
-static unsigned char tx_buf[768];
+static unsigned char tx_buf[CFG_UMAC_TX_WINDOW][768];
+static volatile bool tx_buf_busy[CFG_UMAC_TX_WINDOW];
 static unsigned char tx_ack_buf[768];
 static const long um_tim_id = 123;
 static xTimerHandle um_tim_hdl;
 xSemaphoreHandle um_mutex;
 
+// max time a bulk packet waits for urgent traffic before it is dropped
+#define UM_BULK_TIMEOUT   (100/portTICK_RATE_MS)
+
+// um_mutex is recursive, umac callbacks run under it and may send or reply
+void _impl_umac_lock(void) {
+  (void)xSemaphoreTakeRecursive(um_mutex, portMAX_DELAY);
+}
+
+void _impl_umac_unlock(void) {
+  (void)xSemaphoreGiveRecursive(um_mutex);
+}
+
+// get a tx buffer not used by any synchronized packet in the air
+static unsigned char *_impl_umac_get_tx_buf(void) {
+  int i;
+  for (i = 0; i < CFG_UMAC_TX_WINDOW; i++) {
+    if (!tx_buf_busy[i]) {
+      tx_buf_busy[i] = true;
+      return tx_buf[i];
+    }
+  }
+  return NULL;
+}
+
+static void _impl_umac_put_tx_buf(const uint8_t *b) {
+  int i;
+  for (i = 0; i < CFG_UMAC_TX_WINDOW; i++) {
+    if (b == tx_buf[i]) {
+      tx_buf_busy[i] = false;
+      return;
+    }
+  }
+}
+
 int _impl_umac_tx_pkt(uint8_t ack, uint8_t *buf, uint16_t len) {
-  (void)xSemaphoreTake(um_mutex, portMAX_DELAY);
+  _impl_umac_lock();
   int res;
-  memcpy(tx_buf, buf, len);
-  res = umac_tx_pkt(&um, ack, tx_buf, len);
-  (void)xSemaphoreGive(um_mutex);
+  if (ack) {
+    unsigned char *b = _impl_umac_get_tx_buf();
+    if (b == NULL) {
+      res = -1;
+    } else {
+      memcpy(b, buf, len);
+      res = umac_tx_pkt(&um, ack, b, len);
+      if (res < 0) _impl_umac_put_tx_buf(b);
+    }
+  } else {
+    // unsynchronized packets are sent directly, no need to keep a copy
+    res = umac_tx_pkt(&um, ack, buf, len);
+  }
+  _impl_umac_unlock();
   return res;
 }
 
+int _impl_umac_tx_pktv(uint8_t ack, const umac_seg *segs, uint8_t nsegs) {
+  _impl_umac_lock();
+  int res = umac_tx_pktv(&um, ack, segs, nsegs);
+  _impl_umac_unlock();
+  return res;
+}
+
+int _impl_umac_tx_bulk_pktv(uint8_t ack, const umac_seg *segs, uint8_t nsegs) {
+  portTickType start = xTaskGetTickCount();
+  while (1) {
+    _impl_umac_lock();
+    int res = umac_tx_bulk_pktv(&um, ack, segs, nsegs);
+    _impl_umac_unlock();
+    if (res != UMAC_ERR_BULK_BUSY) return res;
+    portTickType waited = xTaskGetTickCount() - start;
+    if (waited >= UM_BULK_TIMEOUT) return -1;
+    if (uartio_tx_pending() > CFG_UMAC_BULK_PENDING) {
+      // let the uart drain, urgent packets get through meanwhile
+      (void)uartio_tx_wait_pending(CFG_UMAC_BULK_PENDING, UM_BULK_TIMEOUT - waited);
+    } else {
+      // bulk window slots taken, wait for acks
+      vTaskDelay(1);
+    }
+  }
+}
+
+int _impl_umac_try_tx_bulk_pktv(uint8_t ack, const umac_seg *segs, uint8_t nsegs) {
+  _impl_umac_lock();
+  int res = umac_tx_bulk_pktv(&um, ack, segs, nsegs);
+  _impl_umac_unlock();
+  return res;
+}
+
+uint32_t _impl_umac_tx_pending(void) {
+  return uartio_tx_pending();
+}
+
+#ifdef CFG_UMAC_STATS
+void _impl_umac_get_stats(umac_stats *dst, bool reset) {
+  _impl_umac_lock();
+  memcpy(dst, &um.stats, sizeof(umac_stats));
+  if (reset) umac_stats_reset(&um);
+  _impl_umac_unlock();
+}
+#endif
+
+#ifdef CFG_UMAC_SLIP
+void _impl_umac_set_framing(umac_framing framing) {
+  _impl_umac_lock();
+  umac_set_framing(&um, framing);
+  _impl_umac_unlock();
+}
+#endif
+
 int _impl_umac_reply_pkt(uint8_t *buf, uint16_t len) {
-  (void)xSemaphoreTake(um_mutex, portMAX_DELAY);
+  _impl_umac_lock();
   int res;
   memcpy(tx_ack_buf, buf, len);
   res = umac_tx_reply_ack(&um, tx_ack_buf, len);
-  (void)xSemaphoreGive(um_mutex);
+  _impl_umac_unlock();
   return res;
 }
 
 static void uart_task(void *pvParameters) {
-  unsigned char ch;
+  // say hello and negotiate capabilities
+  bridge_ping();
   while (1) {
-    if (read(0, (void*) &ch, 1)) { // 0 is stdin
-      umac_report_rx_byte(&um, ch);
+    uint8_t *data;
+    uint16_t len;
+    (void)uartio_rx_wait(portMAX_DELAY);
+    // acks release tx slots and rx callbacks reply, all umac state is
+    // shared with sending tasks and the tick
+    _impl_umac_lock();
+    while ((len = uartio_rx_span(&data)) > 0) {
+      umac_report_rx_buf(&um, data, len);
+      uartio_rx_consume(len);
     }
+    _impl_umac_unlock();
   }
 }
 
 void um_tim_cb(xTimerHandle xTimer) {
+  // retransmits, must not interleave with other packets on the uart
+  _impl_umac_lock();
   umac_tick(&um);
+  _impl_umac_unlock();
 }
 
 static void umac_impl_request_future_tick(umtick delta_tick) {
@@ -76,13 +190,35 @@ static void umac_impl_cancel_future_tick(void) {
 }
 
 static void umac_impl_tx_byte(uint8_t c) {
-  uart_putc(0, c);
+  uartio_tx(&c, 1);
 }
 
 static void umac_impl_tx_buf(uint8_t *c, uint16_t len) {
-  while (len--) {
-    uart_putc(0, *c++);
+  uartio_tx(c, len);
+}
+
+// stdout shares uart0 with umac, the stm passes text between packets on as
+// debug output, so only write while no packet is being sent
+static long _write_stdout(struct _reent *r, int fd, const char *ptr, int len) {
+  bool locked = um_mutex != NULL;
+  if (locked) _impl_umac_lock();
+  int left = len;
+  while (left > 0) {
+    uint16_t n = left > 0xffff ? 0xffff : left;
+    uartio_tx((const uint8_t *)ptr, n);
+    ptr += n;
+    left -= n;
   }
+  if (locked) _impl_umac_unlock();
+  return len;
+}
+
+static uint32_t umac_impl_tx_pending(void) {
+  return uartio_tx_pending();
+}
+
+static void umac_impl_tx_release(uint8_t seqno, const umac_seg *segs, uint8_t nsegs) {
+  if (nsegs > 0) _impl_umac_put_tx_buf(segs[0].data);
 }
 
 static uint8_t last_rx_seqno = 0;
@@ -107,6 +243,8 @@ static umtick umac_impl_now_tick(void) {
 
 void user_init(void) {
   uart_set_baud(0, 921600);
+  uartio_init();
+  set_write_stdout(_write_stdout);
 
   printf("\n\nESP8266 UMAC\n\n");
 
@@ -120,7 +258,9 @@ void user_init(void) {
       .rx_pkt_fn = umac_impl_rx_pkt,
       .rx_pkt_ack_fn = bridge_pkt_acked,
       .timeout_fn = bridge_timeout,
-      .nonprotocol_data_fn = NULL
+      .nonprotocol_data_fn = NULL,
+      .tx_release_fn = umac_impl_tx_release,
+      .tx_pending_fn = umac_impl_tx_pending
   };
   umac_init(&um, &um_cfg, rx_buf);
 
@@ -135,6 +275,7 @@ void user_init(void) {
   bool setup_ap = true;
 
   systask_init();
+  systask_call(SYS_DDP_LISTEN, false);
   device_id = 0;
   fs_init();
   if (fs_mount() >= 0) {
@@ -224,7 +365,7 @@ void user_init(void) {
   }
 
   server_init(server_actions);
-  um_mutex = xSemaphoreCreateMutex();
+  um_mutex = xSemaphoreCreateRecursiveMutex();
   xTaskCreate(uart_task, (signed char * )"uart_task", 512, NULL, 2, NULL);
   xTaskCreate(server_task, (signed char *)"server_task", 1024, NULL, 2, NULL);
 }
@@ -9,9 +9,12 @@
 #include "../uweb/src/uweb.h"
 #include "../uweb/src/uweb_http.h"
 #include "bridge_esp.h"
+#include "../protocol.h"
 #include "fs.h"
 #include "systasks.h"
 #include "ntp.h"
+#include "uartio.h"
+#include "ddp.h"
 
 uweb_response server_actions(
     uweb_request_header *req, UW_STREAM res, uweb_http_status *http_status,
@@ -29,8 +32,19 @@ uweb_response server_actions(
     bridge_lamp_set_intensity(intensity);
     return UWEB_OK;
   }
+  else if (get_arg_str(req->resource, "fx", arg)) {
+    // fx=<effect>[,<period ms>[,<rrggbb>[,<rrggbb>]]]
+    char *p = arg;
+    uint32_t fx = strtol(p, &p, 10);
+    uint32_t period_ms = *p == ',' ? strtol(p + 1, &p, 10) : 0;
+    uint32_t rgb_a = *p == ',' ? strtol(p + 1, &p, 16) : 0;
+    uint32_t rgb_b = *p == ',' ? strtol(p + 1, &p, 16) : 0;
+    printf("set fx %i\n", fx);
+    bridge_lamp_set_fx(fx, period_ms, rgb_a, rgb_b);
+    return UWEB_OK;
+  }
   else if (get_arg_str(req->resource, "askstat", arg)) {
-    lamp_status *stat = bridge_lamp_get_status(true);
+    lamp_status *stat = bridge_lamp_get_status(false);
     char buf[64];
     sprintf(buf, "%s,%i,#%06x",
         stat->ena ? "1":"0",
@@ -47,6 +61,87 @@ uweb_response server_actions(
     make_char_stream_copy(res, buf);
     return UWEB_CHUNKED;
   }
+#ifdef CFG_UMAC_STATS
+  else if (get_arg_str(req->resource, "umstats", arg)) {
+    umac_stats st;
+    _impl_umac_get_stats(&st, strcmp(arg, "reset") == 0);
+    char buf[512];
+    int l = snprintf(buf, sizeof(buf),
+        "{\"tx_pkts\":%u,\"tx_bytes\":%u,\"rx_pkts\":%u,\"rx_bytes\":%u,"
+        "\"retransmits\":%u,\"timeouts\":%u,\"rx_timeouts\":%u,"
+        "\"crc_errors\":%u,\"garbage\":%u,"
+        "\"tx_nacks\":[%u,%u,%u,%u,%u],\"rx_nacks\":[%u,%u,%u,%u,%u],"
+        "\"tick_ms\":%u,\"ack_lat\":[",
+        st.tx_pkts, st.tx_bytes, st.rx_pkts, st.rx_bytes,
+        st.retransmits, st.timeouts, st.rx_timeouts,
+        st.crc_errors, st.garbage,
+        st.tx_nacks[0], st.tx_nacks[1], st.tx_nacks[2], st.tx_nacks[3], st.tx_nacks[4],
+        st.rx_nacks[0], st.rx_nacks[1], st.rx_nacks[2], st.rx_nacks[3], st.rx_nacks[4],
+        portTICK_RATE_MS);
+    int i;
+    for (i = 0; i < UMAC_STATS_LAT_BUCKETS && l < sizeof(buf); i++) {
+      l += snprintf(&buf[l], sizeof(buf) - l, "%u%s", st.ack_lat[i],
+          i < UMAC_STATS_LAT_BUCKETS - 1 ? "," : "]}");
+    }
+    make_char_stream_copy(res, buf);
+    return UWEB_CHUNKED;
+  }
+#endif
+  else if (get_arg_str(req->resource, "uartstats", arg)) {
+    uartio_stats st;
+    uartio_get_stats(&st, strcmp(arg, "reset") == 0);
+    char buf[256];
+    sprintf(buf,
+        "{\"tx_bytes\":%u,\"tx_blocked\":%u,\"tx_hiwater\":%u,\"tx_ring\":%u,"
+        "\"rx_bytes\":%u,\"rx_bytes_per_s\":%u,\"rx_wakeups\":%u,"
+        "\"rx_ring_full\":%u,\"rx_fifo_ovf\":%u,\"rx_hiwater\":%u,\"rx_ring\":%u}",
+        st.tx_bytes, st.tx_blocked, st.tx_hiwater, UARTIO_TX_RING_SIZE,
+        st.rx_bytes, st.rx_bytes_per_s, st.rx_wakeups,
+        st.rx_ring_full, st.rx_fifo_ovf, st.rx_hiwater, UARTIO_RX_RING_SIZE);
+    make_char_stream_copy(res, buf);
+    return UWEB_CHUNKED;
+  }
+  else if (get_arg_str(req->resource, "bridgeprof", arg)) {
+    // per packet id [calls,us], rx indexed by proto_efm, ack by proto_stm
+    bridge_prof rx[_P_ESP_CNT];
+    bridge_prof ack[_P_STM_CNT];
+    bridge_get_prof(rx, ack, strcmp(arg, "reset") == 0);
+    char buf[640];
+    int l = snprintf(buf, sizeof(buf), "{\"rx\":[");
+    int i;
+    for (i = 0; i < _P_ESP_CNT && l < sizeof(buf); i++) {
+      l += snprintf(&buf[l], sizeof(buf) - l, "[%u,%u]%s", rx[i].calls, rx[i].us,
+          i < _P_ESP_CNT - 1 ? "," : "],\"ack\":[");
+    }
+    for (i = 0; i < _P_STM_CNT && l < sizeof(buf); i++) {
+      l += snprintf(&buf[l], sizeof(buf) - l, "[%u,%u]%s", ack[i].calls, ack[i].us,
+          i < _P_STM_CNT - 1 ? "," : "]}");
+    }
+    make_char_stream_copy(res, buf);
+    return UWEB_CHUNKED;
+  }
+  else if (get_arg_str(req->resource, "udpstats", arg)) {
+    bridge_udp_stats st;
+    bridge_get_udp_stats(&st, strcmp(arg, "reset") == 0);
+    char buf[128];
+    sprintf(buf,
+        "{\"rx\":%u,\"relayed\":%u,\"queue_drops\":%u,\"tx_drops\":%u,\"long_drops\":%u}",
+        st.rx, st.relayed, st.queue_drops, st.tx_drops, st.long_drops);
+    make_char_stream_copy(res, buf);
+    return UWEB_CHUNKED;
+  }
+  else if (get_arg_str(req->resource, "ddpstats", arg)) {
+    ddp_stats st;
+    ddp_get_stats(&st, strcmp(arg, "reset") == 0);
+    char buf[192];
+    sprintf(buf,
+        "{\"rx_pkts\":%u,\"bad_pkts\":%u,\"frames\":%u,\"relayed\":%u,\"drops\":%u,"
+        "\"lat_us_max\":%u,\"lat_us_avg\":%u}",
+        st.rx_pkts, st.bad_pkts, st.frames, st.relayed, st.drops,
+        st.lat_us_max, st.relayed ? st.lat_us_sum / st.relayed : 0);
+    make_char_stream_copy(res, buf);
+    return UWEB_CHUNKED;
+  }
   else if (get_arg_str(req->resource, "ping", arg)) {
     bridge_ping();
     return UWEB_OK;
@@ -11,6 +11,7 @@
 #include "ntp.h"
 #include "udputil.h"
 #include "bridge_esp.h"
+#include "ddp.h"
 
 #define SYSTASK_CLAIM_FLAG (1<<31)
 
@@ -99,6 +100,10 @@ static void systask_task(void *pvParameters) {
         bridge_ping();
       }
       break;
+      case SYS_DDP_LISTEN: {
+        ddp_init();
+      }
+      break;
       case SYS_TEST: {
         uint32_t progress;
         server_claim_busy();
@@ -26,6 +26,7 @@ typedef enum {
   SYS_UDP_RECV,
   SYS_UDP_SEND_RECV,
   SYS_PING,
+  SYS_DDP_LISTEN,
   SYS_TEST,
 } systask_id;
 
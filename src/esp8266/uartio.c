@@ -0,0 +1,253 @@
+/*
+ * uartio.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#include "uartio.h"
+
+#include <string.h>
+#include <esp8266.h>
+#include <esp/uart_regs.h>
+#include <esp/interrupts.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+
+#define UART0                 0
+#define UART_TXFIFO_SIZE      128
+#define TX_RING_MASK          (UARTIO_TX_RING_SIZE - 1)
+#define RX_RING_MASK          (UARTIO_RX_RING_SIZE - 1)
+
+#if (UARTIO_TX_RING_SIZE & TX_RING_MASK) != 0
+#error UARTIO_TX_RING_SIZE must be a power of two
+#endif
+#if (UARTIO_RX_RING_SIZE & RX_RING_MASK) != 0
+#error UARTIO_RX_RING_SIZE must be a power of two
+#endif
+
+#define TXFIFO_COUNT() \
+  ((UART(UART0).STATUS >> UART_STATUS_TXFIFO_COUNT_S) & UART_STATUS_TXFIFO_COUNT_M)
+#define RXFIFO_COUNT() \
+  ((UART(UART0).STATUS >> UART_STATUS_RXFIFO_COUNT_S) & UART_STATUS_RXFIFO_COUNT_M)
+
+#define RX_INTS \
+  (UART_INT_ENABLE_RXFIFO_FULL | UART_INT_ENABLE_RXFIFO_TIMEOUT | UART_INT_ENABLE_RXFIFO_OVERFLOW)
+
+static uint8_t tx_ring[UARTIO_TX_RING_SIZE];
+static volatile uint16_t tx_r;
+static volatile uint16_t tx_w;
+static volatile bool tx_waiting;
+static xSemaphoreHandle tx_sem;
+static volatile bool tx_low_waiting;
+static volatile uint16_t tx_low_level;
+static xSemaphoreHandle tx_low_sem;
+static uint8_t rx_ring[UARTIO_RX_RING_SIZE];
+static volatile uint16_t rx_r;
+static volatile uint16_t rx_w;
+static xSemaphoreHandle rx_sem;
+static portTickType stats_tick;
+static uartio_stats stats;
+
+// move as much as possible from ring to hw fifo, irq or critical context
+static IRAM void _uartio_fill_fifo(void) {
+  uint16_t r = tx_r;
+  uint16_t w = tx_w;
+  uint32_t room = UART_TXFIFO_SIZE - TXFIFO_COUNT();
+  while (r != w && room--) {
+    UART(UART0).FIFO = tx_ring[r];
+    r = (r + 1) & TX_RING_MASK;
+  }
+  tx_r = r;
+  if (r == w) {
+    UART(UART0).INT_ENABLE &= ~UART_INT_ENABLE_TXFIFO_EMPTY;
+  }
+}
+
+// move all of hw fifo to rx ring, irq context
+static IRAM void _uartio_drain_fifo(void) {
+  uint16_t w = rx_w;
+  uint16_t r = rx_r;
+  uint32_t cnt = RXFIFO_COUNT();
+  while (cnt--) {
+    uint8_t c = UART(UART0).FIFO;
+    uint16_t nw = (w + 1) & RX_RING_MASK;
+    if (nw == r) {
+      stats.rx_ring_full++;
+    } else {
+      rx_ring[w] = c;
+      w = nw;
+    }
+  }
+  rx_w = w;
+  uint16_t used = (w - r) & RX_RING_MASK;
+  if (used > stats.rx_hiwater) stats.rx_hiwater = used;
+}
+
+static IRAM void _uartio_isr(void) {
+  uint32_t status = UART(UART0).INT_STATUS;
+  signed portBASE_TYPE woken = pdFALSE;
+  if (status & RX_INTS) {
+    if (status & UART_INT_STATUS_RXFIFO_OVERFLOW) stats.rx_fifo_ovf++;
+    _uartio_drain_fifo();
+    UART(UART0).INT_CLEAR = RX_INTS;
+    xSemaphoreGiveFromISR(rx_sem, &woken);
+  }
+  if (status & UART_INT_STATUS_TXFIFO_EMPTY) {
+    _uartio_fill_fifo();
+    UART(UART0).INT_CLEAR = UART_INT_CLEAR_TXFIFO_EMPTY;
+    if (tx_waiting) {
+      tx_waiting = false;
+      xSemaphoreGiveFromISR(tx_sem, &woken);
+    }
+    if (tx_low_waiting && ((tx_w - tx_r) & TX_RING_MASK) <= tx_low_level) {
+      tx_low_waiting = false;
+      xSemaphoreGiveFromISR(tx_low_sem, &woken);
+    }
+  }
+  if (woken) {
+    portYIELD();
+  }
+}
+
+void uartio_init(void) {
+  vSemaphoreCreateBinary(tx_sem);
+  (void)xSemaphoreTake(tx_sem, 0);
+  vSemaphoreCreateBinary(tx_low_sem);
+  (void)xSemaphoreTake(tx_low_sem, 0);
+  vSemaphoreCreateBinary(rx_sem);
+  (void)xSemaphoreTake(rx_sem, 0);
+  tx_r = tx_w = 0;
+  rx_r = rx_w = 0;
+  memset(&stats, 0, sizeof(stats));
+  stats_tick = xTaskGetTickCount();
+
+  _xt_isr_attach(INUM_UART, _uartio_isr);
+
+  // reset rx fifo
+  uint32_t conf = UART(UART0).CONF0;
+  UART(UART0).CONF0 = conf | UART_CONF0_RXFIFO_RESET;
+  UART(UART0).CONF0 = conf & ~UART_CONF0_RXFIFO_RESET;
+
+  UART(UART0).CONF1 =
+      (UARTIO_TX_FIFO_THRESH << UART_CONF1_TXFIFO_EMPTY_THRESHOLD_S) |
+      (UARTIO_RX_FIFO_THRESH << UART_CONF1_RXFIFO_FULL_THRESHOLD_S) |
+      (UARTIO_RX_TOUT << UART_CONF1_RX_TOUT_THRESHOLD_S) |
+      UART_CONF1_RX_TOUT_ENABLE;
+  UART(UART0).INT_CLEAR = 0x1ff;
+  UART(UART0).INT_ENABLE = RX_INTS;
+  _xt_isr_unmask(1 << INUM_UART);
+}
+
+void uartio_tx(const uint8_t *buf, uint16_t len) {
+  while (len) {
+    // only the writer moves tx_w and the irq only frees space, so copy
+    // into the free part of the ring with interrupts enabled
+    uint16_t w = tx_w;
+    uint16_t free = (tx_r - w - 1) & TX_RING_MASK;
+    uint16_t n = len < free ? len : free;
+    uint16_t span = UARTIO_TX_RING_SIZE - w;
+    if (n <= span) {
+      memcpy(&tx_ring[w], buf, n);
+    } else {
+      memcpy(&tx_ring[w], buf, span);
+      memcpy(&tx_ring[0], buf + span, n - span);
+    }
+    w = (w + n) & TX_RING_MASK;
+    portENTER_CRITICAL();
+    tx_w = w;
+    buf += n;
+    len -= n;
+    stats.tx_bytes += n;
+    uint16_t used = (w - tx_r) & TX_RING_MASK;
+    if (used > stats.tx_hiwater) stats.tx_hiwater = used;
+    tx_waiting = len > 0;
+    UART(UART0).INT_ENABLE |= UART_INT_ENABLE_TXFIFO_EMPTY;
+    portEXIT_CRITICAL();
+    if (len) {
+      // backpressure, wait for the irq to make room
+      stats.tx_blocked++;
+      if (xSemaphoreTake(tx_sem, 1) != pdTRUE) {
+        // not woken within a tick, e.g. when called with interrupts
+        // masked, move bytes ourselves so we never deadlock
+        portENTER_CRITICAL();
+        _uartio_fill_fifo();
+        portEXIT_CRITICAL();
+      }
+    }
+  }
+}
+
+bool uartio_tx_flush(uint32_t timeout) {
+  portTickType start = xTaskGetTickCount();
+  while (tx_r != tx_w || TXFIFO_COUNT() > 0) {
+    if (xTaskGetTickCount() - start >= timeout) {
+      return false;
+    }
+    portENTER_CRITICAL();
+    _uartio_fill_fifo();
+    portEXIT_CRITICAL();
+    vTaskDelay(1);
+  }
+  return true;
+}
+
+uint16_t uartio_tx_free(void) {
+  return (tx_r - tx_w - 1) & TX_RING_MASK;
+}
+
+uint16_t uartio_tx_pending(void) {
+  return (tx_w - tx_r) & TX_RING_MASK;
+}
+
+bool uartio_tx_wait_pending(uint16_t level, uint32_t timeout) {
+  portENTER_CRITICAL();
+  if (((tx_w - tx_r) & TX_RING_MASK) <= level) {
+    portEXIT_CRITICAL();
+    return true;
+  }
+  tx_low_level = level;
+  tx_low_waiting = true;
+  UART(UART0).INT_ENABLE |= UART_INT_ENABLE_TXFIFO_EMPTY;
+  portEXIT_CRITICAL();
+  if (xSemaphoreTake(tx_low_sem, timeout) != pdTRUE) {
+    tx_low_waiting = false;
+    return false;
+  }
+  return true;
+}
+
+uint16_t uartio_rx_wait(uint32_t timeout) {
+  uint16_t avail;
+  while ((avail = (rx_w - rx_r) & RX_RING_MASK) == 0) {
+    if (xSemaphoreTake(rx_sem, timeout) != pdTRUE) {
+      return 0;
+    }
+    stats.rx_wakeups++;
+  }
+  return avail;
+}
+
+uint16_t uartio_rx_span(uint8_t **data) {
+  uint16_t r = rx_r;
+  uint16_t w = rx_w;
+  *data = &rx_ring[r];
+  return w >= r ? w - r : UARTIO_RX_RING_SIZE - r;
+}
+
+void uartio_rx_consume(uint16_t len) {
+  rx_r = (rx_r + len) & RX_RING_MASK;
+  stats.rx_bytes += len;
+}
+
+void uartio_get_stats(uartio_stats *dst, bool reset) {
+  portENTER_CRITICAL();
+  memcpy(dst, &stats, sizeof(uartio_stats));
+  if (reset) memset(&stats, 0, sizeof(uartio_stats));
+  portTickType now = xTaskGetTickCount();
+  uint32_t ms = (now - stats_tick) * portTICK_RATE_MS;
+  if (reset) stats_tick = now;
+  portEXIT_CRITICAL();
+  dst->rx_bytes_per_s = ms ? (uint32_t)(((uint64_t)dst->rx_bytes * 1000) / ms) : 0;
+}
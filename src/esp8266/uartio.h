@@ -0,0 +1,64 @@
+/*
+ * uartio.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#ifndef _ESP8266_UARTIO_H_
+#define _ESP8266_UARTIO_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// uart0 tx ring size, must be a power of two
+#define UARTIO_TX_RING_SIZE   2048
+// refill hw fifo when it holds fewer bytes than this
+#define UARTIO_TX_FIFO_THRESH 16
+// uart0 rx ring size, must be a power of two
+#define UARTIO_RX_RING_SIZE   2048
+// drain hw fifo when it holds this many bytes
+#define UARTIO_RX_FIFO_THRESH 64
+// or when line has been idle for this many byte times
+#define UARTIO_RX_TOUT        4
+
+typedef struct {
+  uint32_t tx_bytes;
+  uint32_t tx_blocked;   // number of times a writer waited for ring space
+  uint16_t tx_hiwater;   // max bytes queued in ring
+  uint16_t rx_hiwater;   // max bytes queued in ring
+  uint32_t rx_bytes;
+  uint32_t rx_bytes_per_s; // average since last reset
+  uint32_t rx_wakeups;   // number of times the reader was woken for data
+  uint32_t rx_ring_full; // bytes dropped due to full ring
+  uint32_t rx_fifo_ovf;  // hw fifo overflows
+} uartio_stats;
+
+/* Sets up interrupt driven uart0 rx and tx. Call after uart baud is set. */
+void uartio_init(void);
+/* Queues data for transmission and returns as soon as all data is in the
+   ring. Blocks while the ring is full. Not reentrant, writers must be
+   serialized, see _impl_umac_lock. */
+void uartio_tx(const uint8_t *buf, uint16_t len);
+/* Waits until ring and hw fifo are drained or timeout ticks passed.
+   Returns true if drained. */
+bool uartio_tx_flush(uint32_t timeout);
+/* Returns free space in tx ring */
+uint16_t uartio_tx_free(void);
+/* Returns number of bytes queued in tx ring */
+uint16_t uartio_tx_pending(void);
+/* Blocks until at most level bytes are queued in tx ring or timeout ticks
+   passed. Returns true if level was reached. Only one waiter is supported. */
+bool uartio_tx_wait_pending(uint16_t level, uint32_t timeout);
+/* Blocks until rx data is available or timeout ticks passed. Returns
+   the number of bytes available. Only one reader task is supported. */
+uint16_t uartio_rx_wait(uint32_t timeout);
+/* Gets a contiguous span of received data in the ring, returns its length.
+   Call uartio_rx_consume when done with it. */
+uint16_t uartio_rx_span(uint8_t **data);
+/* Releases len bytes of received data */
+void uartio_rx_consume(uint16_t len);
+/* Copies statistics, optionally resetting them */
+void uartio_get_stats(uartio_stats *dst, bool reset);
+
+#endif /* _ESP8266_UARTIO_H_ */
@@ -19,8 +19,13 @@
 #include "lwip/api.h"
 #include "lwip/err.h"
 #include "lwip/sockets.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
 
 #define RECV_MAX_LEN  512
+// how often the listener task looks for unlistened ports
+#define LISTEN_POLL_MS  100
 
 static struct {
   uint16_t port;
@@ -44,16 +49,18 @@ void udputil_config(uint32_t ipaddr, uint16_t port, u16_t timeout,
   udp_cfg.recv_cb = recv_cb;
 }
 
-int _udputil_txrx(bool tx, bool rx) {
-  uint8_t *txbuf = udp_cfg.txdata;
-  uint8_t *rxbuf = udp_cfg.rxdata;
-  const uint16_t len = udp_cfg.len;
-  const int port = udp_cfg.port;
-  const int timeout = udp_cfg.timeout;
-  ip_addr_t dst_address;
-
-  dst_address.addr = htonl(udp_cfg.ipaddr);
+static struct {
+  uint16_t port;
+  int sock;
+  bool close;
+  udp_listen_cb_fn cb;
+  void *arg;
+} listeners[UDPUTIL_MAX_LISTENERS];
+static xSemaphoreHandle listen_mutex;
+static xTaskHandle listen_task_hdl;
+static uint8_t listen_buf[UDPUTIL_LISTEN_MAX_LEN];
 
+static int _udputil_bind(uint16_t port) {
   struct sockaddr_in local;
   memset(&local, 0, sizeof(local));
   local.sin_family = AF_INET;
@@ -63,13 +70,29 @@ int _udputil_txrx(bool tx, bool rx) {
   int sock_fd = lwip_socket(AF_INET, SOCK_DGRAM, 0);
   if (sock_fd < 0) {
     printf("socket alloc failed\n");
-    if (rx && udp_cfg.recv_cb) udp_cfg.recv_cb(-1,0,NULL,0);
     return -1;
   }
 
-  if (lwip_bind(sock_fd, (struct sockaddr *)&local, sizeof(local) < 0)) {
+  if (lwip_bind(sock_fd, (struct sockaddr *)&local, sizeof(local)) < 0) {
     printf("bind failed\n");
     lwip_close(sock_fd);
+    return -1;
+  }
+  return sock_fd;
+}
+
+int _udputil_txrx(bool tx, bool rx) {
+  uint8_t *txbuf = udp_cfg.txdata;
+  uint8_t *rxbuf = udp_cfg.rxdata;
+  const uint16_t len = udp_cfg.len;
+  const int port = udp_cfg.port;
+  const int timeout = udp_cfg.timeout;
+  ip_addr_t dst_address;
+
+  dst_address.addr = htonl(udp_cfg.ipaddr);
+
+  int sock_fd = _udputil_bind(port);
+  if (sock_fd < 0) {
     if (rx && udp_cfg.recv_cb) udp_cfg.recv_cb(-1,0,NULL,0);
     return -1;
   }
@@ -137,3 +160,117 @@ int udputil_send_recv(void){
   return _udputil_txrx(true, true);
 }
 
+
+static void udputil_listen_task(void *pvParameters) {
+  while (1) {
+    fd_set fds;
+    int max_fd = -1;
+    int i;
+    // taken under listen_mutex, as udputil_unlisten clears them from other tasks
+    int socks[UDPUTIL_MAX_LISTENERS];
+    udp_listen_cb_fn cbs[UDPUTIL_MAX_LISTENERS];
+    void *args[UDPUTIL_MAX_LISTENERS];
+    FD_ZERO(&fds);
+    (void)xSemaphoreTake(listen_mutex, portMAX_DELAY);
+    for (i = 0; i < UDPUTIL_MAX_LISTENERS; i++) {
+      if (listeners[i].close) {
+        // sockets are only closed here, never while selected on
+        closesocket(listeners[i].sock);
+        listeners[i].port = 0;
+        listeners[i].sock = -1;
+        listeners[i].close = false;
+      }
+      socks[i] = listeners[i].sock;
+      cbs[i] = listeners[i].cb;
+      args[i] = listeners[i].arg;
+      if (socks[i] >= 0) {
+        FD_SET(socks[i], &fds);
+        if (socks[i] > max_fd) max_fd = socks[i];
+      }
+    }
+    (void)xSemaphoreGive(listen_mutex);
+
+    if (max_fd < 0) {
+      vTaskDelay(LISTEN_POLL_MS / portTICK_RATE_MS);
+      continue;
+    }
+    struct timeval tv = { .tv_sec = 0, .tv_usec = LISTEN_POLL_MS * 1000 };
+    if (lwip_select(max_fd + 1, &fds, NULL, NULL, &tv) <= 0) continue;
+
+    for (i = 0; i < UDPUTIL_MAX_LISTENERS; i++) {
+      int sock_fd = socks[i];
+      if (sock_fd < 0 || !FD_ISSET(sock_fd, &fds)) continue;
+      struct sockaddr_in remote;
+      int fromlen = sizeof(remote);
+      int size = lwip_recvfrom(sock_fd, listen_buf, sizeof(listen_buf), MSG_DONTWAIT,
+          (struct sockaddr *) &remote, (socklen_t *) &fromlen);
+      if (size > 0 && cbs[i]) {
+        cbs[i](ntohl(remote.sin_addr.s_addr), ntohs(remote.sin_port),
+            listen_buf, size, args[i]);
+      }
+    }
+  }
+}
+
+int udputil_listen(uint16_t port, udp_listen_cb_fn cb, void *arg) {
+  if (listen_mutex == NULL) {
+    int i;
+    for (i = 0; i < UDPUTIL_MAX_LISTENERS; i++) {
+      listeners[i].sock = -1;
+    }
+    listen_mutex = xSemaphoreCreateMutex();
+  }
+  int res = -1;
+  int i;
+  (void)xSemaphoreTake(listen_mutex, portMAX_DELAY);
+  for (i = 0; i < UDPUTIL_MAX_LISTENERS; i++) {
+    if (listeners[i].port == port) {
+      if (listeners[i].close) {
+        // still bound while waiting to be closed, take it over
+        listeners[i].cb = cb;
+        listeners[i].arg = arg;
+        listeners[i].close = false;
+        res = 0;
+      } else if (listeners[i].cb == cb && listeners[i].arg == arg) {
+        res = 0;
+      } else {
+        // owned by someone else
+        res = -2;
+      }
+      break;
+    }
+  }
+  for (i = 0; res == -1 && i < UDPUTIL_MAX_LISTENERS; i++) {
+    if (listeners[i].port == 0) {
+      int sock_fd = _udputil_bind(port);
+      if (sock_fd >= 0) {
+        listeners[i].port = port;
+        listeners[i].sock = sock_fd;
+        listeners[i].cb = cb;
+        listeners[i].arg = arg;
+        res = 0;
+      }
+      break;
+    }
+  }
+  (void)xSemaphoreGive(listen_mutex);
+  if (res < 0) {
+    printf("listen to port %i failed\n", port);
+  } else if (listen_task_hdl == NULL) {
+    xTaskCreate(udputil_listen_task, (signed char *)"udp_listen", 384, NULL, 2, &listen_task_hdl);
+  }
+  return res;
+}
+
+void udputil_unlisten(uint16_t port, udp_listen_cb_fn cb) {
+  if (listen_mutex == NULL) return;
+  int i;
+  (void)xSemaphoreTake(listen_mutex, portMAX_DELAY);
+  for (i = 0; i < UDPUTIL_MAX_LISTENERS; i++) {
+    if (listeners[i].port == port && listeners[i].sock >= 0 && listeners[i].cb == cb) {
+      listeners[i].cb = NULL;
+      listeners[i].close = true;
+    }
+  }
+  (void)xSemaphoreGive(listen_mutex);
+}
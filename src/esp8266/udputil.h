@@ -17,4 +17,22 @@ int udputil_recv(void);
 int udputil_send(void);
 int udputil_send_recv(void);
 
+// max number of ports listened to at the same time
+#define UDPUTIL_MAX_LISTENERS   3
+
+// max datagram size on listened ports
+#define UDPUTIL_LISTEN_MAX_LEN  1472
+
+/* Called from the listener task for each datagram received on a listened
+   port. ip is in host order. Must not block, the socket is drained meanwhile. */
+typedef void (* udp_listen_cb_fn)(uint32_t ip, uint16_t src_port, uint8_t *buf, uint16_t len, void *arg);
+
+/* Binds a socket to port and keeps it open, calling cb for every datagram
+   until unlistened. A port has one owner, listening again with the same cb
+   and arg is a no-op while another cb is refused.
+   Returns negative on error. */
+int udputil_listen(uint16_t port, udp_listen_cb_fn cb, void *arg);
+/* Stops listening to port, unless it is owned by another cb. */
+void udputil_unlisten(uint16_t port, udp_listen_cb_fn cb);
+
 #endif /* _ESP8266_UDPUTIL_H_ */
@@ -17,7 +17,17 @@
 #define CFG_UMAC_RETRIES              10
 #define CFG_UMAC_RETRY_DELTA(t)       40/portTICK_RATE_MS
 #define CFG_UMAC_RX_TIMEOUT           2*CFG_UMAC_RETRY_DELTA(1)*CFG_UMAC_RETRIES
+#define CFG_UMAC_ADAPTIVE_RTO
+#define CFG_UMAC_STATS
+#define CFG_UMAC_SLIP
+#define CFG_UMAC_LZ
+#define CFG_UMAC_LZ_HASH_BITS         10
+#define CFG_UMAC_FRAG_MAX_LEN         4096
+#define CFG_UMAC_RTO_MIN              2
+#define CFG_UMAC_RTO_MAX              160/portTICK_RATE_MS
+#define CFG_UMAC_TX_WINDOW            4
 #define CFG_UMAC_TICK_TYPE            portTickType
+#define CFG_UMAC_CRC                  UMAC_CRC_TABLE
 #define CFG_UMAC_DBG(...)            //printf( __VA_ARGS__ )
 
 #endif /* _UMAC_CFG_H_ */
@@ -11,9 +11,20 @@
 #include "taskq.h"
 #include "ws2812b_spi_stm32f1.h"
 #include "miniutils.h"
+#include "protocol.h"
+#include "cli.h"
+#include "lamp_fx.h"
+#include "processor.h"
+#include "rtc.h"
 
-#define FACTOR_DELTA      1
-#define TIME_DELTA_MS     6
+// streamed frames take over the leds until none arrived for this long
+#define FRAME_TIMEOUT_MS  2000
+// compositor frame rate, while fading or running an effect
+#ifndef LAMP_FPS
+#define LAMP_FPS          50
+#endif
+// fade time between black and full color, shorter fades are quicker
+#define FADE_MS           500
 
 
 static const u8_t gamma[] = {
@@ -64,23 +75,31 @@ static u32_t src_color = 0;
 static u32_t dst_color = 0;
 static u32_t lst_color = 0;
 static u32_t cur_color = 0;
-static u8_t factor = 0;
-static task *lamp_update_task;
-static task_timer lamp_update_timer;
-static volatile bool lamp_bus_bsy = FALSE;
-static volatile bool lamp_dirty = FALSE;
-
-static u8_t lerp(u8_t a, u8_t b, u8_t f) {
-  u32_t aa = a, bb = b, ff = f;
-  return ((aa<<8) + ff * (bb-aa)) >> 8;
-}
-
-static u32_t lerp_col(u32_t src, u32_t dst, u8_t f) {
-  u8_t r = lerp((src >> 16) & 0xff, (dst >> 16) & 0xff, f);
-  u8_t g = lerp((src >> 8) & 0xff, (dst >> 8) & 0xff, f);
-  u8_t b = lerp((src) & 0xff, (dst) & 0xff, f);
-  return (r<<16) | (g<<8) | b;
-}
+static u32_t fade_ms = 0;
+static u32_t fade_elapsed_ms = 0;
+static u8_t lamp_fps = LAMP_FPS;
+static task *comp_task;
+static task_timer comp_timer;
+static volatile bool comp_running = FALSE;
+static u64_t comp_last_tick;
+static lamp_comp_stats comp_stats;
+static u8_t frame[WS2812B_NBR_OF_LEDS * 3];
+static volatile bool frame_mode = FALSE;
+static bool frame_seq_valid;
+static u8_t frame_seq;
+static volatile bool frame_pending = FALSE;
+static volatile bool frame_showing = FALSE;
+static bool frame_queued = FALSE;
+static sys_time frame_rx_time;
+static sys_time frame_out_time;
+static task *frame_tmo_task;
+static task_timer frame_tmo_timer;
+static lamp_frame_stats frame_stats;
+static u8_t fb[WS2812B_NBR_OF_LEDS * 3];
+static const lamp_fx *fx = NULL;
+static lamp_fx_id fx_id;
+static lamp_fx_state fx_state;
+static lamp_fx_stats fx_stats[_LAMP_FX_CNT];
 
 static u32_t gamma_col(u32_t col) {
   u8_t r = gamma[(col >> 16) & 0xff];
@@ -89,30 +108,65 @@ static u32_t gamma_col(u32_t col) {
   return (r<<16) | (g<<8) | b;
 }
 
+// a frame queued behind the one being sent is either swapped in by now, or
+// is dropped here as the back buffer is about to be overwritten
+static void lamp_frame_settle(void) {
+  if (WS2812B_STM32F1_unqueue()) {
+    if (frame_queued) frame_stats.dropped++;
+  } else if (frame_queued) {
+    frame_stats.shown++;
+  }
+  frame_queued = FALSE;
+}
+
+// sets leds into the back buffer while the front may still be sent
 static void lamp_output(void) {
-  if (!lamp_bus_bsy) {
-    lamp_bus_bsy = TRUE;
-    int i;
-    u32_t col = gamma_col(lerp_col(0, cur_color, light));
-    //print("lamp col %06x (%06x->%06x->%06x/%02x : %02x)\n", col, src_color, cur_color, dst_color, factor, light);
+  if (frame_mode && !frame_pending) return;
+  bool is_frame = frame_mode;
+  int i;
+  lamp_frame_settle();
+  if (is_frame) {
+    WS2812B_STM32F1_set_rgb(frame, WS2812B_NBR_OF_LEDS);
+    frame_pending = FALSE;
+  } else if (fx) {
+    // rendered by lamp_comp_task
     for (i = 0; i < WS2812B_NBR_OF_LEDS; i++) {
-      WS2812B_STM32F1_set(col);
+      u32_t col = (fb[i*3] << 16) | (fb[i*3+1] << 8) | fb[i*3+2];
+      WS2812B_STM32F1_set(gamma_col(LAMP_FX_lerp_col(0, col, light)));
     }
-    APP_claim(CLAIM_SWP);
-    WS2812B_STM32F1_output();
   } else {
-    lamp_dirty = TRUE;
+    u32_t col = gamma_col(LAMP_FX_lerp_col(0, cur_color, light));
+    //print("lamp col %06x (%06x->%06x->%06x/%i : %02x)\n", col, src_color, cur_color, dst_color, fade_elapsed_ms, light);
+    for (i = 0; i < WS2812B_NBR_OF_LEDS; i++) {
+      WS2812B_STM32F1_set(col);
+    }
+  }
+  if (!is_frame) frame_showing = FALSE;
+  // claimed until last queued frame is sent, queued frames join the claim
+  APP_claim(CLAIM_SWP);
+  bool started = WS2812B_STM32F1_output();
+  if (!started) {
+    APP_release(CLAIM_SWP);
+  }
+  if (is_frame) {
+    // timed from here as it is now either sent or queued in the driver
+    frame_out_time = frame_rx_time;
+    frame_showing = TRUE;
+    if (started) {
+      frame_stats.shown++;
+    } else {
+      frame_queued = TRUE;
+    }
   }
 }
 
-static bool lamp_regulate(void) {
-  bool res;
-  if (factor < 0x100 - FACTOR_DELTA) {
-    factor += FACTOR_DELTA;
-    cur_color = lerp_col(src_color, dst_color, factor);
-    res = TRUE;
+// advances fade by elapsed time, fade_ms is cleared when done
+static void lamp_regulate(u32_t dt_ms) {
+  fade_elapsed_ms += dt_ms;
+  if (fade_elapsed_ms < fade_ms) {
+    cur_color = LAMP_FX_lerp_col(src_color, dst_color, (fade_elapsed_ms << 8) / fade_ms);
   } else {
-    factor = 0;
+    fade_ms = 0;
     cur_color = dst_color;
     src_color = dst_color;
     if (lamp_disabling) {
@@ -120,32 +174,193 @@ static bool lamp_regulate(void) {
       APP_release(CLAIM_LMP);
       print("lamp off\n");
     }
-    TASK_stop_timer(&lamp_update_timer);
-    res = FALSE;
   }
-  if (res) lamp_output();
-  return res;
 }
 
 static void lamp_cb_irq(bool error) {
-  lamp_bus_bsy = FALSE;
   APP_release(CLAIM_SWP);
-  if (lamp_dirty) {
-    lamp_dirty = FALSE;
-    print("lamp dirty\n");
+  if (frame_showing) {
+    frame_showing = FALSE;
+    u32_t lat = SYS_get_time_ms() - frame_out_time;
+    frame_stats.lat_ms_sum += lat;
+    frame_stats.lat_cnt++;
+    if (lat > frame_stats.lat_ms_max) frame_stats.lat_ms_max = lat;
+  }
+}
+
+static void lamp_comp_start(void) {
+  if (comp_running) return;
+  comp_running = TRUE;
+  comp_last_tick = RTC_get_tick();
+  TASK_start_timer(comp_task, &comp_timer, 0, NULL, 0, 1000 / lamp_fps, "lamp");
+}
+
+// starts fading from src_color to dst_color, time relative to distance
+static void lamp_update(void) {
+  u32_t d = 0;
+  int i;
+  for (i = 0; i < 24; i += 8) {
+    s32_t dc = ((dst_color >> i) & 0xff) - ((src_color >> i) & 0xff);
+    d = MAX(d, (u32_t)(dc < 0 ? -dc : dc));
+  }
+  // at least one frame, intensity changes are shown at once
+  fade_ms = MAX(FADE_MS * d / 0xff, 1);
+  fade_elapsed_ms = 0;
+  lamp_comp_start();
+}
+
+// stops effect, leaving the lamp at what it currently shows
+static void lamp_fx_stop(void) {
+  if (fx == NULL) return;
+  fx = NULL;
+  cur_color = (fb[0] << 16) | (fb[1] << 8) | fb[2];
+  src_color = cur_color;
+}
+
+static void lamp_fx_done(void) {
+  lamp_fx_stop();
+  if (cur_color == 0) {
+    // ramped down to dark, keep color from before
+    LAMP_enable(FALSE);
+  } else {
+    dst_color = cur_color;
+    WB_lamp_changed();
+  }
+}
+
+// composes a frame from fade or effect, advanced by rtc time elapsed since
+// last frame so late or skipped frames, or stop mode, do not slow them down
+static void lamp_comp_task(u32_t a, void *p) {
+  u64_t now = RTC_get_tick();
+  u32_t dt = MIN(RTC_TICK_TO_MS(now - comp_last_tick), 1000);
+  comp_last_tick = now;
+  u32_t t0 = DWT_CYCCNT;
+
+  if (fade_ms) lamp_regulate(dt);
+  if (fx) {
+    LAMP_FX_advance(fx, &fx_state, dt);
+    lamp_fx_stats *st = &fx_stats[fx_id];
+    if (frame_mode) {
+      st->skipped++;
+    } else {
+      u32_t fx_t0 = DWT_CYCCNT;
+      fx->render(&fx_state, fb, WS2812B_NBR_OF_LEDS);
+      u32_t cycles = DWT_CYCCNT - fx_t0;
+      st->frames++;
+      st->cycles_sum += cycles;
+      if (cycles > st->cycles_max) st->cycles_max = cycles;
+      if (cycles > SystemCoreClock / lamp_fps) st->overruns++;
+    }
+  }
+  if (!frame_mode) {
     lamp_output();
+    u32_t cycles = DWT_CYCCNT - t0;
+    comp_stats.frames++;
+    comp_stats.cycles_sum += cycles;
+    if (cycles > comp_stats.cycles_max) comp_stats.cycles_max = cycles;
+    if (dt > comp_stats.dt_ms_max) comp_stats.dt_ms_max = dt;
+    if (dt > 1500 / lamp_fps) comp_stats.late++;
+  }
+
+  if (fx && fx_state.done) lamp_fx_done();
+  // a fade may have been started above
+  if (fx == NULL && fade_ms == 0) {
+    TASK_stop_timer(&comp_timer);
+    comp_running = FALSE;
+  }
+}
+
+static void lamp_frame_tmo_task(u32_t a, void *p) {
+  frame_mode = FALSE;
+  frame_pending = FALSE;
+  APP_release(CLAIM_LMP);
+  print("lamp stream ended\n");
+  // back to whatever the lamp shows by itself
+  lamp_output();
+}
+
+static void lamp_rx_frame(u8_t *data, u16_t len) {
+  u8_t seq = data[1];
+  u8_t flags = data[2];
+  u16_t first = (data[3] << 8) | data[4];
+  u16_t leds = (len - 5) / 3;
+  frame_stats.pkts++;
+  if (!frame_mode) {
+    frame_mode = TRUE;
+    frame_seq_valid = FALSE;
+    APP_claim(CLAIM_LMP);
+    print("lamp stream started\n");
+  }
+  TASK_stop_timer(&frame_tmo_timer);
+  TASK_start_timer(frame_tmo_task, &frame_tmo_timer, 0, NULL, FRAME_TIMEOUT_MS, 0, "lampfrm");
+
+  if (first < WS2812B_NBR_OF_LEDS) {
+    leds = MIN(leds, WS2812B_NBR_OF_LEDS - first);
+    memcpy(&frame[first * 3], &data[5], leds * 3);
+  }
+  if ((flags & P_FRAME_SHOW) == 0) return;
+
+  frame_stats.frames++;
+  if (frame_seq_valid) frame_stats.lost += (u8_t)(seq - frame_seq - 1);
+  frame_seq = seq;
+  frame_seq_valid = TRUE;
+  if (frame_pending) frame_stats.dropped++;
+  frame_rx_time = SYS_get_time_ms();
+  frame_pending = TRUE;
+  lamp_output();
+}
+
+static void lamp_rx_ena(u8_t *data, u16_t len) {
+  LAMP_enable(data[1] != 0);
+}
+
+static void lamp_rx_intensity(u8_t *data, u16_t len) {
+  u32_t i = data[1];
+  if (i < LAMP_MIN_INTENSITY) {
+    LAMP_enable(FALSE);
   } else {
-    //lamp_regulate();
+    LAMP_set_intensity(i);
+    LAMP_enable(TRUE);
   }
 }
 
-static void lamp_task(u32_t a, void *p) {
-  lamp_regulate();
+static void lamp_rx_color(u8_t *data, u16_t len) {
+  LAMP_set_color((data[1] << 16) | (data[2] << 8) | (data[3]));
 }
 
-static void lamp_update(void) {
-  TASK_stop_timer(&lamp_update_timer);
-  TASK_start_timer(lamp_update_task, &lamp_update_timer, 0, NULL, 2, 2, "lamp");
+static void lamp_rx_status(u8_t *data, u16_t len) {
+  LAMP_enable(data[1] != 0);
+  LAMP_set_intensity(data[2]);
+  LAMP_set_color((data[3] << 16) | (data[4] << 8) | (data[5]));
+}
+
+static void lamp_rx_fx(u8_t *data, u16_t len) {
+  u32_t period_ms = len >= 6 ? (data[2] << 24) | (data[3] << 16) | (data[4] << 8) | data[5] : 0;
+  u32_t col_a = len >= 9 ? (data[6] << 16) | (data[7] << 8) | data[8] : 0;
+  u32_t col_b = len >= 12 ? (data[9] << 16) | (data[10] << 8) | data[11] : 0;
+  LAMP_set_fx(data[1], period_ms, col_a, col_b);
+}
+
+static void lamp_rx_get_ena(u8_t *data, u16_t len) {
+  u8_t rsp[] = { data[0], LAMP_on() };
+  WB_reply(rsp, sizeof(rsp));
+}
+
+static void lamp_rx_get_intensity(u8_t *data, u16_t len) {
+  u8_t rsp[] = { data[0], LAMP_get_intensity() };
+  WB_reply(rsp, sizeof(rsp));
+}
+
+static void lamp_rx_get_color(u8_t *data, u16_t len) {
+  u32_t rgb = LAMP_get_color();
+  u8_t rsp[] = { data[0], rgb>>16, rgb>>8, rgb };
+  WB_reply(rsp, sizeof(rsp));
+}
+
+static void lamp_rx_get_status(u8_t *data, u16_t len) {
+  u32_t rgb = LAMP_get_color();
+  u8_t rsp[] = { data[0], LAMP_on(), LAMP_get_intensity(), rgb>>16, rgb>>8, rgb };
+  WB_reply(rsp, sizeof(rsp));
 }
 
 void LAMP_init(void) {
@@ -156,20 +371,33 @@ void LAMP_init(void) {
   cur_color = 0;
   cycle = 0x0000;
   light = 0x30;
-  factor = 0;
-  lamp_update_task = TASK_create(lamp_task, TASK_STATIC);
+  fade_ms = 0;
+  comp_task = TASK_create(lamp_comp_task, TASK_STATIC);
+  frame_tmo_task = TASK_create(lamp_frame_tmo_task, TASK_STATIC);
+
+  WB_register_rx(P_STM_LAMP_ENA, 2, lamp_rx_ena);
+  WB_register_rx(P_STM_LAMP_INTENSITY, 2, lamp_rx_intensity);
+  WB_register_rx(P_STM_LAMP_COLOR, 4, lamp_rx_color);
+  WB_register_rx(P_STM_LAMP_STATUS, 6, lamp_rx_status);
+  WB_register_rx(P_STM_LAMP_GET_ENA, 1, lamp_rx_get_ena);
+  WB_register_rx(P_STM_LAMP_GET_INTENSITY, 1, lamp_rx_get_intensity);
+  WB_register_rx(P_STM_LAMP_GET_COLOR, 1, lamp_rx_get_color);
+  WB_register_rx(P_STM_LAMP_GET_STATUS, 1, lamp_rx_get_status);
+  WB_register_rx(P_STM_LAMP_FRAME, 5, lamp_rx_frame);
+  WB_register_rx(P_STM_LAMP_FX, 2, lamp_rx_fx);
 }
 
 void LAMP_enable(bool ena) {
   if (!ena) {
+    lamp_fx_stop();
     if (lamp_enabled) {
       src_color = cur_color;
       lst_color = dst_color;
       dst_color = 0x000000;
-      factor = 0;
       lamp_enabled = FALSE;
       lamp_disabling = TRUE;
       lamp_update();
+      WB_lamp_changed();
       print("lamp out\n");
     }
   } else {
@@ -179,6 +407,7 @@ void LAMP_enable(bool ena) {
       APP_claim(CLAIM_LMP);
       dst_color = lst_color;
       lamp_update();
+      WB_lamp_changed();
       print("lamp on\n");
     }
   }
@@ -189,10 +418,11 @@ bool LAMP_on(void) {
 }
 
 void LAMP_set_color(u32_t rgb) {
+  lamp_fx_stop();
   src_color = cur_color;
   dst_color = rgb;
-  factor = 0;
   lamp_update();
+  WB_lamp_changed();
 }
 
 void LAMP_set_intensity(u8_t i) {
@@ -200,8 +430,8 @@ void LAMP_set_intensity(u8_t i) {
   light = i;
   light = MAX(light, LAMP_MIN_INTENSITY);
   light = MIN(light, LAMP_MAX_INTENSITY);
-  factor = 0;
   lamp_update();
+  WB_lamp_changed();
 }
 
 u32_t LAMP_get_color(void) {
@@ -215,12 +445,13 @@ u8_t LAMP_get_intensity(void) {
 
 void LAMP_cycle_delta(s16_t dcycle) {
   const u8_t colcount = sizeof(colors)/sizeof(colors[0]);
+  lamp_fx_stop();
   cycle += dcycle;
   cycle %= (colcount<<8) | 0xff;
   src_color = cur_color;
-  dst_color = lerp_col(colors[cycle>>8], colors[((cycle>>8)+1)%colcount], cycle & 0xff);
-  factor = 0;
+  dst_color = LAMP_FX_lerp_col(colors[cycle>>8], colors[((cycle>>8)+1)%colcount], cycle & 0xff);
   lamp_update();
+  WB_lamp_changed();
 }
 
 void LAMP_light_delta(s8_t dlight) {
@@ -228,8 +459,114 @@ void LAMP_light_delta(s8_t dlight) {
   light += dlight;
   light = MAX(light, 0x20);
   light = MIN(light, 0xf0);
-  factor = 0;
   lamp_update();
+  WB_lamp_changed();
+}
+
+void LAMP_set_fx(lamp_fx_id id, u32_t period_ms, u32_t col_a, u32_t col_b) {
+  const lamp_fx *f = LAMP_FX_get(id);
+  if (f == NULL) {
+    if (fx) {
+      lamp_fx_stop();
+      lamp_output();
+    }
+    return;
+  }
+  memset(&fx_state, 0, sizeof(lamp_fx_state));
+  fx_state.period_ms = period_ms ? period_ms : f->period_ms;
+  fx_state.col_a = col_a ? col_a : LAMP_get_color();
+  fx_state.col_b = col_b ? col_b : (~fx_state.col_a & 0xffffff);
+  fx_id = id;
+  fx = f;
+  LAMP_enable(TRUE);
+  lamp_comp_start();
+  print("lamp fx %s\n", f->name);
 }
 
+void LAMP_get_fx_stats(lamp_fx_id id, lamp_fx_stats *dst, bool reset) {
+  if (id >= _LAMP_FX_CNT) return;
+  memcpy(dst, &fx_stats[id], sizeof(lamp_fx_stats));
+  if (reset) memset(&fx_stats[id], 0, sizeof(lamp_fx_stats));
+}
+
+void LAMP_set_fps(u8_t fps) {
+  if (fps == 0) return;
+  lamp_fps = fps;
+  if (comp_running) {
+    TASK_stop_timer(&comp_timer);
+    TASK_start_timer(comp_task, &comp_timer, 0, NULL, 1000 / lamp_fps, 1000 / lamp_fps, "lamp");
+  }
+}
+
+void LAMP_get_comp_stats(lamp_comp_stats *dst, bool reset) {
+  memcpy(dst, &comp_stats, sizeof(lamp_comp_stats));
+  if (reset) memset(&comp_stats, 0, sizeof(lamp_comp_stats));
+}
+
+void LAMP_get_frame_stats(lamp_frame_stats *dst, bool reset) {
+  memcpy(dst, &frame_stats, sizeof(lamp_frame_stats));
+  if (reset) memset(&frame_stats, 0, sizeof(lamp_frame_stats));
+}
+
+static s32_t cli_frames(u32_t argc, u32_t reset) {
+  lamp_frame_stats st;
+  LAMP_get_frame_stats(&st, argc > 0 && reset);
+  print("frame pkts:%i frames:%i shown:%i dropped:%i lost:%i\n",
+      st.pkts, st.frames, st.shown, st.dropped, st.lost);
+  print("latency max:%ims avg:%ims\n",
+      st.lat_ms_max, st.lat_cnt ? st.lat_ms_sum / st.lat_cnt : 0);
+  return CLI_OK;
+}
+
+static s32_t cli_leds(u32_t argc, u32_t reset) {
+  ws2812b_stats st;
+  WS2812B_STM32F1_get_stats(&st, argc > 0 && reset);
+  u32_t avg = st.frames ? st.cycles_sum / st.frames : 0;
+  print("leds frames:%i overlaps:%i dropped:%i dma avg:%ius max:%ius\n",
+      st.frames, st.overlaps, st.dropped,
+      avg / (SystemCoreClock / 1000000), st.cycles_max / (SystemCoreClock / 1000000));
+  return CLI_OK;
+}
+
+static s32_t cli_comp(u32_t argc, u32_t reset) {
+  lamp_comp_stats st;
+  LAMP_get_comp_stats(&st, argc > 0 && reset);
+  u32_t avg = st.frames ? st.cycles_sum / st.frames : 0;
+  print("comp fps:%i frames:%i late:%i dt max:%ims avg:%ius max:%ius\n",
+      lamp_fps, st.frames, st.late, st.dt_ms_max,
+      avg / (SystemCoreClock / 1000000), st.cycles_max / (SystemCoreClock / 1000000));
+  return CLI_OK;
+}
+
+static s32_t cli_fps(u32_t argc, u32_t fps) {
+  if (argc > 0) LAMP_set_fps(fps);
+  print("lamp fps:%i\n", lamp_fps);
+  return CLI_OK;
+}
+
+static s32_t cli_fx(u32_t argc, u32_t id, u32_t period_ms) {
+  LAMP_set_fx(argc > 0 ? id : LAMP_FX_NONE, argc > 1 ? period_ms : 0, 0, 0);
+  return CLI_OK;
+}
+
+static s32_t cli_fx_stats(u32_t argc, u32_t reset) {
+  lamp_fx_id id;
+  for (id = LAMP_FX_NONE + 1; id < _LAMP_FX_CNT; id++) {
+    lamp_fx_stats st;
+    LAMP_get_fx_stats(id, &st, argc > 0 && reset);
+    u32_t avg = st.frames ? st.cycles_sum / st.frames : 0;
+    print("%s frames:%i skipped:%i overruns:%i avg:%ius max:%ius\n",
+        LAMP_FX_get(id)->name, st.frames, st.skipped, st.overruns,
+        avg / (SystemCoreClock / 1000000), st.cycles_max / (SystemCoreClock / 1000000));
+  }
+  return CLI_OK;
+}
 
+CLI_MENU_START(lamp)
+CLI_FUNC("frames", cli_frames, "Dumps streamed frame statistics, (<reset 0/1>)")
+CLI_FUNC("leds", cli_leds, "Dumps led output statistics, (<reset 0/1>)")
+CLI_FUNC("comp", cli_comp, "Dumps compositor frame statistics, (<reset 0/1>)")
+CLI_FUNC("fps", cli_fps, "Sets or gets compositor frame rate, (<fps>)")
+CLI_FUNC("fx", cli_fx, "Starts effect, <1:gradient 2:hue 3:breathe 4:sunrise 5:sunset> (<period ms>), none stops")
+CLI_FUNC("fxstats", cli_fx_stats, "Dumps effect render cost, (<reset 0/1>)")
+CLI_MENU_END
@@ -8,9 +8,38 @@
 #ifndef _LAMP_H_
 #define _LAMP_H_
 
+#include "lamp_fx.h"
+
 #define LAMP_MIN_INTENSITY 0x20
 #define LAMP_MAX_INTENSITY 0xf0
 
+typedef struct {
+  u32_t pkts;         // frame packets received
+  u32_t frames;       // complete frames received
+  u32_t shown;        // frames sent to leds
+  u32_t dropped;      // replaced by a newer frame before sent, here or in driver
+  u32_t lost;         // never received, from sequence gaps
+  u32_t lat_ms_max;   // from frame received until output done, for frames
+  u32_t lat_ms_sum;   // sent last before the leds went idle
+  u32_t lat_cnt;
+} lamp_frame_stats;
+
+typedef struct {
+  u32_t frames;       // rendered frames
+  u32_t skipped;      // not rendered, streamed frames shown
+  u32_t overruns;     // render and encode took longer than a frame
+  u32_t cycles_max;   // render and encode cost
+  u32_t cycles_sum;
+} lamp_fx_stats;
+
+typedef struct {
+  u32_t frames;       // composed frames, fading or running effect
+  u32_t late;         // started more than half a frame period late
+  u32_t dt_ms_max;    // longest time between frames
+  u32_t cycles_max;   // advance, render and encode cost
+  u32_t cycles_sum;
+} lamp_comp_stats;
+
 void LAMP_init(void);
 void LAMP_enable(bool ena);
 bool LAMP_on(void);
@@ -20,6 +49,20 @@ u32_t LAMP_get_color(void);
 u8_t LAMP_get_intensity(void);
 void LAMP_cycle_delta(s16_t dcycle);
 void LAMP_light_delta(s8_t dlight);
+void LAMP_get_frame_stats(lamp_frame_stats *dst, bool reset);
+/**
+ * Starts effect, enabling the lamp. Zero period or colors give defaults,
+ * col_a defaults to current color. LAMP_FX_NONE, setting a color, cycling
+ * or disabling the lamp stops the effect. Ramps stop by themselves.
+ */
+void LAMP_set_fx(lamp_fx_id id, u32_t period_ms, u32_t col_a, u32_t col_b);
+void LAMP_get_fx_stats(lamp_fx_id id, lamp_fx_stats *dst, bool reset);
+/**
+ * Sets compositor frame rate, default LAMP_FPS. Fades and effects advance
+ * by elapsed time, so the rate only changes smoothness.
+ */
+void LAMP_set_fps(u8_t fps);
+void LAMP_get_comp_stats(lamp_comp_stats *dst, bool reset);
 
 
 #endif /* _LAMP_H_ */
@@ -0,0 +1,141 @@
+/*
+ * lamp_fx.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#include "lamp_fx.h"
+
+#define PHASE_MASK    (LAMP_FX_PHASE_ONE - 1)
+
+static const u32_t sunrise_palette[] = {
+    0x000000,
+    0x100000,
+    0x400400,
+    0xa01800,
+    0xff4000,
+    0xff8020,
+    0xffc070,
+    0xffe0b0,
+};
+
+static u8_t lerp(u8_t a, u8_t b, u8_t f) {
+  u32_t aa = a, bb = b, ff = f;
+  return ((aa<<8) + ff * (bb-aa)) >> 8;
+}
+
+u32_t LAMP_FX_lerp_col(u32_t src, u32_t dst, u8_t f) {
+  u8_t r = lerp((src >> 16) & 0xff, (dst >> 16) & 0xff, f);
+  u8_t g = lerp((src >> 8) & 0xff, (dst >> 8) & 0xff, f);
+  u8_t b = lerp((src) & 0xff, (dst) & 0xff, f);
+  return (r<<16) | (g<<8) | b;
+}
+
+static void put_col(u8_t *fb, u32_t col) {
+  fb[0] = col >> 16;
+  fb[1] = col >> 8;
+  fb[2] = col;
+}
+
+// 0..0xffff..0 over one cycle
+static u32_t triangle(u32_t phase) {
+  phase &= PHASE_MASK;
+  return phase < 0x8000 ? phase << 1 : (PHASE_MASK - phase) << 1;
+}
+
+// h 0..0x5ff around the color wheel
+static u32_t hue_col(u32_t h) {
+  u8_t f = h & 0xff;
+  switch (h >> 8) {
+  case 0: return 0xff0000 | (f << 8);
+  case 1: return ((0xff - f) << 16) | 0x00ff00;
+  case 2: return 0x00ff00 | f;
+  case 3: return ((0xff - f) << 8) | 0x0000ff;
+  case 4: return (f << 16) | 0x0000ff;
+  default: return 0xff0000 | (0xff - f);
+  }
+}
+
+static void fx_gradient(lamp_fx_state *st, u8_t *fb, u16_t leds) {
+  u32_t step = LAMP_FX_PHASE_ONE / leds;
+  u32_t pos = st->phase;
+  u16_t i;
+  for (i = 0; i < leds; i++) {
+    put_col(&fb[i*3], LAMP_FX_lerp_col(st->col_a, st->col_b, triangle(pos) >> 8));
+    pos += step;
+  }
+}
+
+static void fx_hue(lamp_fx_state *st, u8_t *fb, u16_t leds) {
+  u32_t step = LAMP_FX_PHASE_ONE / leds;
+  u32_t pos = st->phase;
+  u16_t i;
+  for (i = 0; i < leds; i++) {
+    put_col(&fb[i*3], hue_col(((pos & PHASE_MASK) * 0x600) >> 16));
+    pos += step;
+  }
+}
+
+static void fx_breathe(lamp_fx_state *st, u8_t *fb, u16_t leds) {
+  // squared triangle lingers dim and passes the top quickly, as breathing
+  u32_t t = triangle(st->phase);
+  u32_t level = 0x20 + (((t * t) >> 16) * 0xdf >> 16);
+  u32_t col = LAMP_FX_lerp_col(0, st->col_a, level);
+  u16_t i;
+  for (i = 0; i < leds; i++) {
+    put_col(&fb[i*3], col);
+  }
+}
+
+static u32_t sun_col(u32_t progress) {
+  const u32_t last = sizeof(sunrise_palette)/sizeof(sunrise_palette[0]) - 1;
+  u32_t pos = progress * last;
+  u32_t ix = pos >> 16;
+  if (ix >= last) return sunrise_palette[last];
+  return LAMP_FX_lerp_col(sunrise_palette[ix], sunrise_palette[ix+1], (pos >> 8) & 0xff);
+}
+
+static void fx_sunrise(lamp_fx_state *st, u8_t *fb, u16_t leds) {
+  u32_t col = sun_col(st->phase);
+  u16_t i;
+  for (i = 0; i < leds; i++) {
+    put_col(&fb[i*3], col);
+  }
+}
+
+static void fx_sunset(lamp_fx_state *st, u8_t *fb, u16_t leds) {
+  u32_t col = sun_col(LAMP_FX_PHASE_ONE - st->phase);
+  u16_t i;
+  for (i = 0; i < leds; i++) {
+    put_col(&fb[i*3], col);
+  }
+}
+
+static const lamp_fx fxs[_LAMP_FX_CNT] = {
+    [LAMP_FX_GRADIENT] = { .name = "gradient", .period_ms = 20000, .ramp = FALSE, .render = fx_gradient },
+    [LAMP_FX_HUE] = { .name = "hue", .period_ms = 10000, .ramp = FALSE, .render = fx_hue },
+    [LAMP_FX_BREATHE] = { .name = "breathe", .period_ms = 5000, .ramp = FALSE, .render = fx_breathe },
+    [LAMP_FX_SUNRISE] = { .name = "sunrise", .period_ms = 30*60*1000, .ramp = TRUE, .render = fx_sunrise },
+    [LAMP_FX_SUNSET] = { .name = "sunset", .period_ms = 30*60*1000, .ramp = TRUE, .render = fx_sunset },
+};
+
+const lamp_fx *LAMP_FX_get(lamp_fx_id id) {
+  if (id <= LAMP_FX_NONE || id >= _LAMP_FX_CNT) return NULL;
+  return &fxs[id];
+}
+
+void LAMP_FX_advance(const lamp_fx *fx, lamp_fx_state *st, u32_t dt_ms) {
+  // phase += dt / period in 16.16, remainder carried to next frame
+  u32_t num = (dt_ms << 16) + st->phase_rem;
+  st->phase += num / st->period_ms;
+  st->phase_rem = num % st->period_ms;
+  if (fx->ramp) {
+    if (st->phase >= LAMP_FX_PHASE_ONE) {
+      st->phase = LAMP_FX_PHASE_ONE;
+      st->done = TRUE;
+    }
+  } else {
+    st->phase &= PHASE_MASK;
+  }
+}
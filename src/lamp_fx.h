@@ -0,0 +1,58 @@
+/*
+ * lamp_fx.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#ifndef _LAMP_FX_H_
+#define _LAMP_FX_H_
+
+#include "system.h"
+
+// one full effect cycle, or a whole ramp, in phase units
+#define LAMP_FX_PHASE_ONE   0x10000
+
+typedef enum {
+  LAMP_FX_NONE = 0,
+  LAMP_FX_GRADIENT,   // col_a to col_b and back around the ring, rotating
+  LAMP_FX_HUE,        // rainbow around the ring, rotating
+  LAMP_FX_BREATHE,    // col_a fading in and out
+  LAMP_FX_SUNRISE,    // ramp from dark via red and orange to warm white
+  LAMP_FX_SUNSET,     // sunrise backwards
+  _LAMP_FX_CNT
+} lamp_fx_id;
+
+typedef struct {
+  u32_t period_ms;    // time of one cycle, or of the whole ramp
+  u32_t col_a;
+  u32_t col_b;
+  u32_t phase;        // 16.16 fixed point cycles, ramps stop at LAMP_FX_PHASE_ONE
+  u32_t phase_rem;    // remainder of phase advance, keeps slow effects from drifting
+  bool done;          // ramp finished
+} lamp_fx_state;
+
+// renders leds rgb triplets into fb, linear, before intensity and gamma
+typedef void (* lamp_fx_render_fn)(lamp_fx_state *st, u8_t *fb, u16_t leds);
+
+typedef struct {
+  const char *name;
+  u32_t period_ms;    // default period
+  bool ramp;
+  lamp_fx_render_fn render;
+} lamp_fx;
+
+/**
+ * Returns effect with given id, or NULL for LAMP_FX_NONE or bad id.
+ */
+const lamp_fx *LAMP_FX_get(lamp_fx_id id);
+/**
+ * Advances effect phase by elapsed time.
+ */
+void LAMP_FX_advance(const lamp_fx *fx, lamp_fx_state *st, u32_t dt_ms);
+/**
+ * Blends src to dst by f/256, per channel.
+ */
+u32_t LAMP_FX_lerp_col(u32_t src, u32_t dst, u8_t f);
+
+#endif /* _LAMP_FX_H_ */
@@ -288,10 +288,17 @@ static void SPI_config() {
 }
 
 
+static void DWT_config() {
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT_CYCCNT = 0;
+  DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+}
+
 void PROC_base_init() {
   RCC_config();
   NVIC_config();
   TIM_config();
+  DWT_config();
 }
 
 void PROC_periph_init() {
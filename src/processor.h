@@ -8,6 +8,11 @@
 #ifndef PROCESSOR_H_
 #define PROCESSOR_H_
 
+// cortex-m3 dwt cycle counter, enabled in PROC_base_init, for profiling
+#define DWT_CTRL         (*(volatile u32_t *)0xe0001000)
+#define DWT_CYCCNT       (*(volatile u32_t *)0xe0001004)
+#define DWT_CTRL_CYCCNTENA  (1<<0)
+
 void PROC_base_init();
 void PROC_periph_init();
 
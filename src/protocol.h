@@ -8,9 +8,16 @@
 #ifndef SRC_PROTOCOL_H_
 #define SRC_PROTOCOL_H_
 
+// capabilities, exchanged in hello packets
+#define P_CAP_SLIP                (1<<0)  // accepts slip framed packets
+#define P_CAP_LZ                  (1<<1)  // accepts lz compressed packets
+
+// P_STM_LAMP_FRAME flags
+#define P_FRAME_SHOW              (1<<0)  // last part of frame, display it
+
 // packet ids to stm from esp
 typedef enum {
-  P_STM_HELLO = 0,
+  P_STM_HELLO = 0,          // [ping:4]([caps]), ACK:[ping:4]([common caps])
   P_STM_LAMP_ENA,           // [on/off]
   P_STM_LAMP_INTENSITY,     // [intensity]
   P_STM_LAMP_COLOR,         // [red][green][blue]
@@ -21,19 +28,32 @@ typedef enum {
   P_STM_LAMP_GET_STATUS,    // ACK:[on/off][intensity][red][green][blue]
   P_STM_CURRENT_TIME,       //
   P_STM_RECV_UDP,           // [addr:3][addr:2][addr:1][addr:0]<payload>
+  P_STM_FRAG,               // [msgid][last|ix_h][ix_l]<fragment>, see umac_frag.h
+  P_STM_LZ,                 // <compressed packet>, see umac_lz.h
+  P_STM_BATCH,              // [len]<packet>([len]<packet>..), packets applied in order, must not reply
+  P_STM_UDP_DATA,           // [addr:3][addr:2][addr:1][addr:0][port_h][port_l][drops]<payload>, unsynchronized unless fragmented
+  P_STM_LAMP_FRAME,         // [seq][flags][first_h][first_l]<[red][green][blue]..>, unsynchronized, flags see P_FRAME_*
+  P_STM_LAMP_FX,            // [fx]([period:3][period:2][period:1][period:0]([red][green][blue]([red][green][blue]))), see lamp_fx.h
+
+  _P_STM_CNT
 } proto_stm;
 
 // packet ids to esp from stm
 typedef enum {
-  P_ESP_HELLO = 0,
+  P_ESP_HELLO = 0,          // [ping:4]([caps]), ACK:[ping:4]([common caps])
   P_ESP_SEND_UDP,           // [addr:3][addr:2][addr:1][addr:0][port_h][port_l]<payload>
   P_ESP_RECV_UDP,           // [addr:3][addr:2][addr:1][addr:0][port_h][port_l][tmo_h][tmo_l]
   P_ESP_SEND_RECV_UDP,      // [addr:3][addr:2][addr:1][addr:0][port_h][port_l][tmo_h][tmo_l]<payload>
   P_ESP_REQUEST_TIME,       //
   P_ESP_AP_SCAN,            //
   P_ESP_AP_CFG,             // [len_ssid_str]<ssid_str>[len_passw_str]<passw_str>
+  P_ESP_FRAG,               // [msgid][last|ix_h][ix_l]<fragment>, see umac_frag.h
+  P_ESP_LZ,                 // <compressed packet>, see umac_lz.h
+  P_ESP_LAMP_STATUS,        // [on/off][intensity][red][green][blue], pushed on change until acked
+  P_ESP_UDP_SUBSCRIBE,      // [port_h][port_l], ACK:[port_h][port_l][res], datagrams to port are relayed as P_STM_UDP_DATA
+  P_ESP_UDP_UNSUBSCRIBE,    // [port_h][port_l]
 
-
+  _P_ESP_CNT
 } proto_efm;
 
 #endif /* SRC_PROTOCOL_H_ */
@@ -0,0 +1,28 @@
+/*
+ * gpio.h
+ *
+ * Host stand-in for the stm32 gpio header, all calls do nothing.
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#ifndef _GPIO_H_
+#define _GPIO_H_
+
+enum { PORTA, PORTB, PORTC };
+enum {
+  PIN0, PIN1, PIN2, PIN3, PIN4, PIN5, PIN6, PIN7,
+  PIN8, PIN9, PIN10, PIN11, PIN12, PIN13, PIN14, PIN15
+};
+enum { CLK_50MHZ };
+enum { OUT, AF, IN };
+enum { AF0 };
+enum { PUSHPULL };
+enum { NOPULL };
+
+static inline void gpio_config(int port, int pin, int clk, int mode, int af, int pp, int pull) {}
+static inline void gpio_enable(int port, int pin) {}
+static inline void gpio_disable(int port, int pin) {}
+
+#endif /* _GPIO_H_ */
@@ -0,0 +1,99 @@
+/*
+ * system.h
+ *
+ * Host stand-in for the stm32 system header, just what the ws2812b driver
+ * needs to build on the host. Peripherals are plain structs, driven by the
+ * host program where needed.
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#ifndef _SYSTEM_H_
+#define _SYSTEM_H_
+
+#include <stdint.h>
+#include <string.h>
+
+typedef uint8_t u8_t;
+typedef uint16_t u16_t;
+typedef uint32_t u32_t;
+typedef int32_t s32_t;
+typedef uint8_t bool;
+
+#define TRUE                  1
+#define FALSE                 0
+#define MAX(a,b)              ((a)>(b)?(a):(b))
+#define MIN(a,b)              ((a)<(b)?(a):(b))
+
+#define irq_disable()
+#define irq_enable()
+
+// keeps the target processor.h and its dwt registers out
+#define PROCESSOR_H_
+extern volatile u32_t sim_dwt_cyccnt;
+#define DWT_CYCCNT            sim_dwt_cyccnt
+
+#define __IO                  volatile
+#define ENABLE                1
+
+static inline u32_t __REV(u32_t v) { return __builtin_bswap32(v); }
+
+// rcc
+#define RCC_APB1Periph_SPI2   0
+#define RCC_AHBPeriph_DMA1    0
+static inline void RCC_APB1PeriphClockCmd(u32_t p, int e) {}
+static inline void RCC_AHBPeriphClockCmd(u32_t p, int e) {}
+
+// spi
+typedef struct {
+  __IO u32_t CR1, CR2, SR, DR;
+} SPI_TypeDef;
+typedef struct {
+  int SPI_Direction, SPI_Mode, SPI_DataSize, SPI_CPOL, SPI_CPHA, SPI_NSS,
+    SPI_BaudRatePrescaler, SPI_FirstBit, SPI_CRCPolynomial;
+} SPI_InitTypeDef;
+enum {
+  SPI_Direction_1Line_Tx, SPI_Mode_Master, SPI_DataSize_8b, SPI_CPOL_High,
+  SPI_CPHA_1Edge, SPI_NSS_Soft, SPI_BaudRatePrescaler_16, SPI_FirstBit_MSB
+};
+#define SPI_I2S_DMAReq_Tx     2
+#define SPI2_BASE             0x40003800
+extern SPI_TypeDef sim_spi2;
+#define SPI2                  (&sim_spi2)
+static inline void SPI_Init(SPI_TypeDef *s, SPI_InitTypeDef *c) {}
+static inline void SPI_I2S_DMACmd(SPI_TypeDef *s, int r, int e) {}
+
+// dma
+typedef struct {
+  __IO u32_t CCR, CNDTR, CPAR, CMAR;
+} DMA_Channel_TypeDef;
+typedef struct {
+  u32_t DMA_PeripheralBaseAddr, DMA_MemoryBaseAddr;
+  int DMA_DIR, DMA_BufferSize, DMA_PeripheralInc, DMA_MemoryInc,
+    DMA_PeripheralDataSize, DMA_MemoryDataSize, DMA_Mode, DMA_Priority, DMA_M2M;
+} DMA_InitTypeDef;
+enum {
+  DMA_PeripheralInc_Disable, DMA_MemoryInc_Enable, DMA_PeripheralDataSize_Byte,
+  DMA_MemoryDataSize_Byte, DMA_Mode_Normal, DMA_Mode_Circular,
+  DMA_Priority_VeryHigh, DMA_M2M_Disable, DMA_DIR_PeripheralDST
+};
+#define DMA_CCR1_EN           0x01
+#define DMA_CCR1_CIRC         0x20
+#define DMA_IT_TC             0x02
+#define DMA_IT_HT             0x04
+#define DMA_IT_TE             0x08
+#define DMA1_IT_TC5           0x00020000
+#define DMA1_IT_HT5           0x00040000
+#define DMA1_IT_TE5           0x00080000
+extern DMA_Channel_TypeDef sim_dma1_ch5;
+#define DMA1_Channel5         (&sim_dma1_ch5)
+static inline void DMA_DeInit(DMA_Channel_TypeDef *d) {}
+static inline void DMA_Init(DMA_Channel_TypeDef *d, DMA_InitTypeDef *c) {}
+static inline void DMA_ITConfig(DMA_Channel_TypeDef *d, u32_t i, int e) {}
+// pending irq flags, raised by the dma emulation of the host program
+extern volatile u32_t sim_dma_it;
+static inline int DMA_GetITStatus(u32_t i) { return (sim_dma_it & i) != 0; }
+static inline void DMA_ClearITPendingBit(u32_t i) { sim_dma_it &= ~i; }
+
+#endif /* _SYSTEM_H_ */
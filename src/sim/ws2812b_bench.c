@@ -0,0 +1,98 @@
+/*
+ * ws2812b_bench.c
+ *
+ * Host benchmark of the ws2812b led coding. The driver is built in with
+ * stubbed peripherals, and leds are coded into its buffer with the old bit
+ * loop, per led with WS2812B_STM32F1_set, and per frame with
+ * WS2812B_STM32F1_set_rgb. Both driver paths are checked byte for byte
+ * against the bit loop before the time per frame is measured.
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../ws2812b_spi_stm32f1.c"
+#include "ws2812b_ref.h"
+
+volatile u32_t sim_dwt_cyccnt;
+volatile u32_t sim_dma_it;
+SPI_TypeDef sim_spi2;
+DMA_Channel_TypeDef sim_dma1_ch5;
+
+static u8_t fb[3 * WS2812B_NBR_OF_LEDS];
+static u8_t ref[RGB_BUF_LEN];
+
+static void ref_frame(void) {
+  ws2812b_ref_code(&ref[RESET_LEN], fb, WS2812B_NBR_OF_LEDS);
+}
+
+static void set_frame(void) {
+  u32_t i;
+  rgb_ix = RESET_LEN;
+  for (i = 0; i < WS2812B_NBR_OF_LEDS; i++) {
+    WS2812B_STM32F1_set((fb[i*3] << 16) | (fb[i*3+1] << 8) | fb[i*3+2]);
+  }
+}
+
+static void set_rgb_frame(void) {
+  rgb_ix = RESET_LEN;
+  WS2812B_STM32F1_set_rgb(fb, WS2812B_NBR_OF_LEDS);
+}
+
+static int check(const char *name) {
+  if (memcmp(ref, rgb_data[back], sizeof(ref)) != 0) {
+    printf("%u leds: %s differs from bit loop\n", WS2812B_NBR_OF_LEDS, name);
+    return -1;
+  }
+  return 0;
+}
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// ns per frame, best of a few rounds
+static double bench(void (*frame)(void), u32_t frames) {
+  double best = 0;
+  int r;
+  for (r = 0; r < 5; r++) {
+    u32_t n;
+    double t0 = now_ns();
+    for (n = 0; n < frames; n++) {
+      frame();
+      __asm__ volatile("" ::: "memory");
+    }
+    double t = (now_ns() - t0) / frames;
+    if (r == 0 || t < best) best = t;
+  }
+  return best;
+}
+
+int main(int argc, char **argv) {
+  u32_t frames = argc > 1 ? strtoul(argv[1], NULL, 0) : 20000;
+  u32_t i;
+  srand(1);
+  for (i = 0; i < sizeof(fb); i++) {
+    fb[i] = rand();
+  }
+  WS2812B_STM32F1_init(NULL);
+
+  ref_frame();
+  set_frame();
+  if (check("WS2812B_STM32F1_set")) return 1;
+  memset(rgb_data[back], 0, sizeof(rgb_data[back]));
+  set_rgb_frame();
+  if (check("WS2812B_STM32F1_set_rgb")) return 1;
+
+  double t_ref = bench(ref_frame, frames);
+  double t_set = bench(set_frame, frames);
+  double t_set_rgb = bench(set_rgb_frame, frames);
+  printf("%4u leds: bit loop %7.0f, set %7.0f, set_rgb %7.0f ns per frame\n",
+      WS2812B_NBR_OF_LEDS, t_ref, t_set, t_set_rgb);
+  return 0;
+}
@@ -0,0 +1,340 @@
+/*
+ * ws2812b_dma.c
+ *
+ * Host check of the ws2812b driver output paths. The driver is built in
+ * with stubbed peripherals, and dma1 channel 5 is emulated: a started
+ * transfer is read from memory when it completes, or half by half in
+ * circular mode, raising half transfer and transfer complete irqs in
+ * between. All bytes read make up the wire, which is checked against the
+ * reference coding of the frames output.
+ *
+ * Checks, in full buffer mode and with WS2812B_STREAM:
+ *   - a frame goes out as reset, coded leds and trailing zeroes, and in
+ *     stream mode the channel stops once a whole half of zeroes followed
+ *     the last led
+ *   - a frame output while another is sent is queued and sent back to back
+ *   - setting leds while a frame is queued drops it, so it is never sent,
+ *     nor is a frame sent half set
+ *   - the callback comes once per busy period
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "../ws2812b_spi_stm32f1.c"
+#include "ws2812b_ref.h"
+
+volatile u32_t sim_dwt_cyccnt;
+volatile u32_t sim_dma_it;
+SPI_TypeDef sim_spi2;
+DMA_Channel_TypeDef sim_dma1_ch5;
+
+// written to CNDTR once a transfer is taken, a restart by the driver
+// writes a new count
+#define SIM_DMA_TAKEN     0xffffffff
+#define SIM_WIRE_MAX      (64 * 1024 + 4 * 9 * WS2812B_NBR_OF_LEDS)
+
+#ifdef WS2812B_STREAM
+#define MODE              "stream"
+// zeroes before the first led, and at least after the last
+#define RESET_MIN         STREAM_HALF_LEN
+#define TAIL_MIN          STREAM_HALF_LEN
+#else
+#define MODE              "buffer"
+#define RESET_MIN         RESET_LEN
+#define TAIL_MIN          RESET_LEN
+#endif
+
+static struct {
+  u8_t *buf;
+  u32_t len;
+  u32_t pos;
+  u8_t circ;
+} dma;
+
+static u8_t wire[SIM_WIRE_MAX];
+static u32_t wire_len;
+static u32_t callbacks;
+static u32_t callback_errs;
+static u8_t fb[4][3 * WS2812B_NBR_OF_LEDS];
+
+static void callback(bool error) {
+  callbacks++;
+  if (error) callback_errs++;
+}
+
+static void wire_add(const u8_t *d, u32_t len) {
+  if (wire_len + len > sizeof(wire)) len = sizeof(wire) - wire_len;
+  memcpy(&wire[wire_len], d, len);
+  wire_len += len;
+}
+
+// finds the buffer the driver pointed the channel to, CMAR only holds the
+// low 32 bits of a host address
+static u8_t *sim_dma_mem(u32_t cmar) {
+#ifdef WS2812B_STREAM
+  if ((u32_t)(uintptr_t)stream_data == cmar) return stream_data;
+#else
+  if ((u32_t)(uintptr_t)rgb_data[0] == cmar) return rgb_data[0];
+  if ((u32_t)(uintptr_t)rgb_data[1] == cmar) return rgb_data[1];
+#endif
+  return NULL;
+}
+
+// runs the channel until the next irq, returns FALSE if idle
+static bool sim_dma_step(void) {
+  DMA_Channel_TypeDef *ch = DMA1_Channel5;
+  if (!(ch->CCR & DMA_CCR1_EN)) return FALSE;
+  if (ch->CNDTR != SIM_DMA_TAKEN) {
+    // started or restarted by the driver
+    dma.buf = sim_dma_mem(ch->CMAR);
+    dma.len = ch->CNDTR;
+    dma.pos = 0;
+    dma.circ = (ch->CCR & DMA_CCR1_CIRC) != 0;
+    ch->CNDTR = SIM_DMA_TAKEN;
+    if (dma.buf == NULL) {
+      printf("dma started on unknown memory\n");
+      exit(1);
+    }
+  } else if (dma.pos >= dma.len) {
+    // normal mode transfer done
+    return FALSE;
+  }
+  if (dma.circ) {
+    u32_t half = dma.len / 2;
+    wire_add(&dma.buf[dma.pos], half);
+    dma.pos += half;
+    sim_dma_it |= dma.pos == half ? DMA1_IT_HT5 : DMA1_IT_TC5;
+    if (dma.pos >= dma.len) dma.pos = 0;
+  } else {
+    wire_add(&dma.buf[dma.pos], dma.len - dma.pos);
+    dma.pos = dma.len;
+    sim_dma_it |= DMA1_IT_TC5;
+  }
+  DMA1_Channel5_IRQHandler();
+  return TRUE;
+}
+
+// advances a frame being sent without finishing it, in full buffer mode a
+// frame is read in one go so nothing happens
+static void sim_dma_mid(void) {
+#ifdef WS2812B_STREAM
+  (void)sim_dma_step();
+#endif
+}
+
+static void sim_dma_run(void) {
+  u32_t steps = 0;
+  while (sim_dma_step()) {
+    if (++steps > SIM_WIRE_MAX) {
+      printf("dma never stops\n");
+      exit(1);
+    }
+  }
+}
+
+static void sim_reset(void) {
+  memset(&sim_dma1_ch5, 0, sizeof(sim_dma1_ch5));
+  memset(&stats, 0, sizeof(stats));
+  sim_dma_it = 0;
+  wire_len = 0;
+  callbacks = 0;
+  callback_errs = 0;
+  WS2812B_STM32F1_init(callback);
+}
+
+// first half of the leds of a frame, with set_rgb
+static void set_first_half(int f) {
+  WS2812B_STM32F1_set_rgb(fb[f], WS2812B_NBR_OF_LEDS / 2);
+}
+
+// second half of the leds of a frame, per led
+static void set_second_half(int f) {
+  u32_t i;
+  for (i = WS2812B_NBR_OF_LEDS / 2; i < WS2812B_NBR_OF_LEDS; i++) {
+    WS2812B_STM32F1_set((fb[f][i*3] << 16) | (fb[f][i*3+1] << 8) | fb[f][i*3+2]);
+  }
+}
+
+static void set_frame(int f) {
+  set_first_half(f);
+  set_second_half(f);
+}
+
+// checks that the wire holds given frames back to back, each after at
+// least a reset of zeroes and the last followed by at least the tail
+static int check_wire(const char *name, const int *frames, int nframes) {
+  static u8_t ref[9 * WS2812B_NBR_OF_LEDS];
+  u32_t ix = 0;
+  int f;
+  for (f = 0; f < nframes; f++) {
+    u32_t zeroes = 0;
+    // coded leds never hold a zero byte
+    while (ix < wire_len && wire[ix] == 0) {
+      zeroes++;
+      ix++;
+    }
+    u32_t want = f == 0 ? RESET_MIN : TAIL_MIN;
+    if (zeroes < want) {
+      printf("%s: frame %i after %u zeroes, want %u\n", name, f, zeroes, want);
+      return -1;
+    }
+    ws2812b_ref_code(ref, fb[frames[f]], WS2812B_NBR_OF_LEDS);
+    if (ix + sizeof(ref) > wire_len || memcmp(&wire[ix], ref, sizeof(ref)) != 0) {
+      printf("%s: frame %i is not frame %c\n", name, f, 'A' + frames[f]);
+      return -1;
+    }
+    ix += sizeof(ref);
+  }
+  u32_t tail = 0;
+  while (ix < wire_len && wire[ix] == 0) {
+    tail++;
+    ix++;
+  }
+  if (ix != wire_len) {
+    printf("%s: %u bytes more than %i frames on the wire\n", name, wire_len - ix, nframes);
+    return -1;
+  }
+  if (tail < TAIL_MIN) {
+    printf("%s: %u zeroes after last led, want %u\n", name, tail, (u32_t)TAIL_MIN);
+    return -1;
+  }
+  return 0;
+}
+
+static int check_stats(const char *name, u32_t frames, u32_t overlaps, u32_t dropped,
+    u32_t busy_periods) {
+  if (stats.frames != frames || stats.overlaps != overlaps || stats.dropped != dropped) {
+    printf("%s: frames %u overlaps %u dropped %u, want %u %u %u\n", name,
+        stats.frames, stats.overlaps, stats.dropped, frames, overlaps, dropped);
+    return -1;
+  }
+  if (callbacks != busy_periods || callback_errs) {
+    printf("%s: %u callbacks, %u with error, want %u\n", name, callbacks, callback_errs,
+        busy_periods);
+    return -1;
+  }
+  if (WS2812B_STM32F1_busy()) {
+    printf("%s: still busy\n", name);
+    return -1;
+  }
+  return 0;
+}
+
+// one frame on its own
+static int seq_single(void) {
+  sim_reset();
+  set_frame(0);
+  if (!WS2812B_STM32F1_output()) return -1;
+  sim_dma_run();
+  if (check_wire("single", (int[]){0}, 1)) return -1;
+  return check_stats("single", 1, 0, 0, 1);
+}
+
+// frame output while one is sent goes out right after it, the next frame
+// is set while both are in the air
+static int seq_queued(void) {
+  sim_reset();
+  set_frame(0);
+  if (!WS2812B_STM32F1_output()) return -1;
+  sim_dma_mid();
+  set_frame(1);
+  sim_dma_mid();
+  if (WS2812B_STM32F1_output()) {
+    printf("queued: output started while sending\n");
+    return -1;
+  }
+  sim_dma_mid();
+  sim_dma_run();
+  if (check_wire("queued", (int[]){0, 1}, 2)) return -1;
+  return check_stats("queued", 2, 1, 0, 1);
+}
+
+// setting leds while a frame is queued drops it, the replacement is sent
+static int seq_replaced(void) {
+  sim_reset();
+  set_frame(0);
+  (void)WS2812B_STM32F1_output();
+  set_frame(1);
+  (void)WS2812B_STM32F1_output();
+  sim_dma_mid();
+  set_frame(2);
+  sim_dma_mid();
+  (void)WS2812B_STM32F1_output();
+  sim_dma_run();
+  if (check_wire("replaced", (int[]){0, 2}, 2)) return -1;
+  return check_stats("replaced", 2, 2, 1, 1);
+}
+
+// a frame being set when the frame before it is done is not sent half set
+static int seq_half_set(void) {
+  sim_reset();
+  set_frame(0);
+  (void)WS2812B_STM32F1_output();
+  set_frame(1);
+  (void)WS2812B_STM32F1_output();
+  set_first_half(2);
+  sim_dma_run();
+  set_second_half(2);
+  if (!WS2812B_STM32F1_output()) return -1;
+  sim_dma_run();
+  if (check_wire("half set", (int[]){0, 2}, 2)) return -1;
+  return check_stats("half set", 2, 1, 1, 2);
+}
+
+// an unqueued frame is not sent
+static int seq_unqueued(void) {
+  sim_reset();
+  set_frame(0);
+  (void)WS2812B_STM32F1_output();
+  set_frame(1);
+  (void)WS2812B_STM32F1_output();
+  if (!WS2812B_STM32F1_unqueue() || WS2812B_STM32F1_unqueue()) {
+    printf("unqueued: unqueue did not find the queued frame once\n");
+    return -1;
+  }
+  sim_dma_run();
+  if (check_wire("unqueued", (int[]){0}, 1)) return -1;
+  return check_stats("unqueued", 1, 1, 1, 1);
+}
+
+// frames output one after another, each when the previous is done
+static int seq_idle_between(void) {
+  int f;
+  sim_reset();
+  for (f = 0; f < 4; f++) {
+    set_frame(f);
+    if (!WS2812B_STM32F1_output()) return -1;
+    sim_dma_run();
+  }
+  if (check_wire("idle between", (int[]){0, 1, 2, 3}, 4)) return -1;
+  if (stats.frames != 4 || stats.overlaps != 0 || callbacks != 4) {
+    printf("idle between: frames %u overlaps %u callbacks %u, want 4 0 4\n",
+        stats.frames, stats.overlaps, callbacks);
+    return -1;
+  }
+  return 0;
+}
+
+int main(void) {
+  u32_t i;
+  int f;
+  srand(WS2812B_NBR_OF_LEDS);
+  for (f = 0; f < 4; f++) {
+    for (i = 0; i < sizeof(fb[f]); i++) {
+      fb[f][i] = rand();
+    }
+  }
+  if (seq_single()) return 1;
+  if (seq_queued()) return 1;
+  if (seq_replaced()) return 1;
+  if (seq_half_set()) return 1;
+  if (seq_unqueued()) return 1;
+  if (seq_idle_between()) return 1;
+  printf("%4u leds, %s: single, queued, replaced, half set, unqueued and idle frames ok\n",
+      WS2812B_NBR_OF_LEDS, MODE);
+  return 0;
+}
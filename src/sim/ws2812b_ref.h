@@ -0,0 +1,40 @@
+/*
+ * ws2812b_ref.h
+ *
+ * Reference ws2812b coding for the host programs, the bit loop the driver
+ * used before its code table. Each rgb byte becomes eight 3 bit codes,
+ * msb first, sent in grb order.
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#ifndef _WS2812B_REF_H_
+#define _WS2812B_REF_H_
+
+static void ws2812b_ref_codify(u8_t *dst, u8_t d) {
+  int i;
+  u32_t o = 0;
+  for (i = 0; i < 8; i++) {
+    o <<= 3;
+    o |= d & 0b10000000 ? 0b110 : 0b100;
+    d <<= 1;
+  }
+  dst[0] = (o >> 16) & 0xff;
+  dst[1] = (o >> 8) & 0xff;
+  dst[2] = o & 0xff;
+}
+
+// codes leds from rgb into dst, 9 bytes per led
+static void ws2812b_ref_code(u8_t *dst, const u8_t *rgb, u32_t leds) {
+  while (leds--) {
+    //grb
+    ws2812b_ref_codify(&dst[0], rgb[1]);
+    ws2812b_ref_codify(&dst[3], rgb[0]);
+    ws2812b_ref_codify(&dst[6], rgb[2]);
+    dst += 9;
+    rgb += 3;
+  }
+}
+
+#endif /* _WS2812B_REF_H_ */
@@ -2,6 +2,7 @@
 #include "stm32f10x_it.h"
 #include "uart_driver.h"
 #include "timer.h"
+#include "app.h"
 
 #ifdef CONFIG_SPI
 #include "spi_driver.h"
@@ -104,6 +105,9 @@ void DebugMon_Handler(void)
 void USART1_IRQHandler(void)
 {
   //TRACE_IRQ_ENTER(USART1_IRQn);
+#ifdef CONFIG_WIFI_RX_RING
+  WB_uart_rx_irq();
+#endif
   UART_irq(&__uart_vec[0]);
   //TRACE_IRQ_EXIT(USART1_IRQn);
 }
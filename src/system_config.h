@@ -196,6 +196,19 @@ typedef u16_t system_counter_type;
 /** APP **/
 
 #define WS2812B_NBR_OF_LEDS 16
+// lamp compositor frame rate while fading or running effects
+#define LAMP_FPS            50
+// code leds just in time into a small circular dma buffer instead of keeping
+// all leds coded, 3 instead of 9 bytes ram per led, for long strips
+//#define WS2812B_STREAM
+//#define WS2812B_STREAM_LEDS 8 // leds per dma half, multiple of 4
+
+// wifi uart rx bytes are put in a ring by the usart irq, bypassing the io
+// layer, and fed to umac in spans on idle line or half full ring.
+// USART1 rx dma cannot be used, DMA1 channel 5 is taken by SPI2 tx for the
+// ws2812b
+#define CONFIG_WIFI_RX_RING
+#define WIFI_RX_RING_SIZE   512 // power of two
 #define CONFIG_RTC_CLOCK_HZ 32768
 #define CONFIG_RTC_PRESCALER 32
 
@@ -0,0 +1,37 @@
+/*
+ * umac_cfg.h
+ *
+ * umac configuration for the host simulator, timing as on the stm with
+ * one tick per ms. Window, crc engine and bulk pending bytes may be given
+ * by the makefile.
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#ifndef _UMAC_CFG_H_
+#define _UMAC_CFG_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+
+//#define CFG_UMAC_NACK_GARBAGE
+#define CFG_UMAC_RETRIES             10
+#define CFG_UMAC_RETRY_DELTA(t)      40
+#define CFG_UMAC_RX_TIMEOUT          2*CFG_UMAC_RETRY_DELTA(1)*CFG_UMAC_RETRIES
+#define CFG_UMAC_ADAPTIVE_RTO
+#define CFG_UMAC_STATS
+#define CFG_UMAC_SLIP
+#define CFG_UMAC_FRAG_MAX_LEN        4096
+#define CFG_UMAC_RTO_MIN             4
+#define CFG_UMAC_RTO_MAX             160
+#ifndef CFG_UMAC_TX_WINDOW
+#define CFG_UMAC_TX_WINDOW           4
+#endif
+#ifndef CFG_UMAC_CRC
+#define CFG_UMAC_CRC                 UMAC_CRC_TABLE
+#endif
+#define CFG_UMAC_DBG(...)            //printf( __VA_ARGS__ )
+
+#endif /* _UMAC_CFG_H_ */
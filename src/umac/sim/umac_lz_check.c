@@ -0,0 +1,257 @@
+/*
+ * umac_lz_check.c
+ *
+ * Host check and benchmark of umac_lz.
+ *
+ * Round trips representative and random payloads, feeds the decoder
+ * random and damaged streams which must be refused or decoded within
+ * bounds, then reports compression ratio, effective uart rate and coding
+ * time per byte for representative payloads. Build with a sanitizer to
+ * catch out of bounds access, as the makefile does for the checks.
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include "umac_lz.h"
+
+#define LZ_PKT_MAX        768
+// as the bridges, packets under this are sent plain
+#define LZ_MIN_LEN        64
+// uart payload rate at 921600 baud, as measured by the umac simulator
+#define LZ_UART_KBS       92.0
+
+static umac_lz_enc lz;
+// incompressible data grows by a flag byte per eight literals
+static uint8_t cbuf[LZ_PKT_MAX + LZ_PKT_MAX / 8 + 1];
+static uint8_t dbuf[LZ_PKT_MAX];
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+//
+// payloads
+//
+
+// html as served by the esp, first packet of it
+static uint16_t pl_html(uint8_t *d, const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (f == NULL) return 0;
+  uint16_t n = fread(d, 1, LZ_PKT_MAX, f);
+  fclose(f);
+  return n;
+}
+
+// ap scan records laid out as sdk_bss_info:
+// next, bssid, ssid, ssid_len, channel, rssi, authmode, hidden, freq_offs
+static uint16_t pl_apscan(uint8_t *d) {
+  static const char *ssids[] = {
+      "TeliaGateway58-98-35-A1-B2", "NETGEAR42", "eduroam", "Bredband2-4G",
+      "AndroidAP", "HP-Print-3F-LaserJet", "Linksys01234", "ComHem5G"
+  };
+  uint16_t o = 0;
+  int i;
+  for (i = 0; i < 16; i++) {
+    uint8_t *r = &d[o];
+    const char *s = ssids[i % 8];
+    memset(r, 0, 48);
+    r[0] = 0x3f; r[1] = 0x80; r[2] = 0; r[3] = 0x10 + i;
+    r[4] = 0x58; r[5] = 0x98; r[6] = 0x35;
+    r[7] = rand(); r[8] = rand(); r[9] = rand();
+    memcpy(&r[10], s, strlen(s));
+    r[42] = strlen(s);
+    r[43] = 1 + (i * 5) % 13;
+    r[44] = -40 - rand() % 50;
+    r[46] = i % 4;
+    o += 48;
+  }
+  return o;
+}
+
+// umac statistics as json
+static uint16_t pl_json(uint8_t *d) {
+  return snprintf((char *)d, LZ_PKT_MAX,
+      "{\"tx_pkts\":%u,\"tx_bytes\":%u,\"rx_pkts\":%u,\"rx_bytes\":%u,"
+      "\"retransmits\":%u,\"timeouts\":%u,\"rx_timeouts\":%u,\"crc_errors\":%u,"
+      "\"garbage\":%u,\"rx_resyncs\":%u,\"tx_nacks\":[%u,%u,%u,%u,%u],"
+      "\"rx_nacks\":[%u,%u,%u,%u,%u],\"ack_lat\":[%u,%u,%u,%u,%u,%u,%u,%u]}",
+      123456, 8765432, 120034, 4456789, 12, 0, 1, 3, 40, 2,
+      0, 1, 3, 0, 0, 0, 0, 2, 0, 0, 9812, 2014, 123, 4, 0, 0, 0, 0);
+}
+
+// a frame of leds in a gradient
+static uint16_t pl_rgb(uint8_t *d) {
+  int i;
+  for (i = 0; i < LZ_PKT_MAX; i++) {
+    d[i] = i % 3 == 0 ? 255 - i / 3 : i % 3 == 1 ? i / 3 : 128;
+  }
+  return LZ_PKT_MAX;
+}
+
+static uint16_t pl_random(uint8_t *d) {
+  int i;
+  for (i = 0; i < LZ_PKT_MAX; i++) {
+    d[i] = rand();
+  }
+  return LZ_PKT_MAX;
+}
+
+//
+// checks
+//
+
+static int roundtrip(const uint8_t *src, uint16_t len) {
+  int c = umac_lz_compress(&lz, src, len, cbuf, sizeof(cbuf));
+  if (c < 0) return -1;
+  int d = umac_lz_decompress(cbuf, c, dbuf, sizeof(dbuf));
+  if (d != len || memcmp(dbuf, src, len) != 0) return -1;
+  return 0;
+}
+
+static int check_roundtrip(uint32_t iters) {
+  uint8_t src[LZ_PKT_MAX];
+  uint32_t k;
+  for (k = 0; k < iters; k++) {
+    uint16_t n = rand() % (LZ_PKT_MAX + 1);
+    uint16_t i;
+    // alternate between small alphabets, which match a lot, and any byte
+    for (i = 0; i < n; i++) {
+      src[i] = k & 1 ? "abcab"[rand() % 5] : rand();
+    }
+    if (roundtrip(src, n)) {
+      printf("round trip failed, %u bytes, iteration %u\n", n, k);
+      return -1;
+    }
+    // compressing into too small a buffer must fail rather than overrun
+    if (n > 0) {
+      uint16_t lim = rand() % n;
+      int c = umac_lz_compress(&lz, src, n, cbuf, lim);
+      if (c > lim) {
+        printf("compressed %u bytes to %i, past limit %u\n", n, c, lim);
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+static int check_corrupt(uint32_t iters) {
+  uint8_t src[LZ_PKT_MAX];
+  uint32_t k;
+  for (k = 0; k < iters; k++) {
+    uint16_t n;
+    uint16_t i;
+    if (k & 1) {
+      // random stream, with mostly references in every other round
+      n = rand() % 300;
+      for (i = 0; i < n; i++) {
+        cbuf[i] = rand() & (k & 2 ? 0xff : 0x3);
+      }
+    } else {
+      // valid stream with a few bytes damaged or cut short
+      uint16_t len = 1 + rand() % LZ_PKT_MAX;
+      for (i = 0; i < len; i++) {
+        src[i] = "abcab"[rand() % 5];
+      }
+      int c = umac_lz_compress(&lz, src, len, cbuf, sizeof(cbuf));
+      if (c <= 0) continue;
+      n = c;
+      for (i = 0; i < 3; i++) {
+        cbuf[rand() % n] ^= 1 << (rand() % 8);
+      }
+      if (rand() & 1) n = rand() % n;
+    }
+    // decoding into a short buffer must stay within it
+    uint16_t dst_len = k & 4 ? sizeof(dbuf) : rand() % sizeof(dbuf);
+    int d = umac_lz_decompress(cbuf, n, dbuf, dst_len);
+    if (d > dst_len) {
+      printf("decoded %i bytes past limit %u\n", d, dst_len);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+//
+// benchmark
+//
+
+static void bench(const char *name, const uint8_t *src, uint16_t len, uint32_t iters) {
+  int c = 0;
+  uint32_t k;
+  double t0 = now_ns();
+  for (k = 0; k < iters; k++) {
+    // give up unless at least two bytes are saved, including container id
+    c = len >= LZ_MIN_LEN ? umac_lz_compress(&lz, src, len, cbuf, len - 3) : -1;
+    __asm__ volatile("" ::: "memory");
+  }
+  double t_enc = (now_ns() - t0) / iters / len;
+  double t_dec = 0;
+  if (c > 0) {
+    t0 = now_ns();
+    for (k = 0; k < iters; k++) {
+      (void)umac_lz_decompress(cbuf, c, dbuf, sizeof(dbuf));
+      __asm__ volatile("" ::: "memory");
+    }
+    t_dec = (now_ns() - t0) / iters / len;
+  }
+  uint16_t wire = c > 0 ? c + 1 : len;
+  printf("%-10s %4u -> %4u  ratio %.2f  eff %5.1f kB/s  enc %4.1f ns/B  dec %4.1f ns/B%s\n",
+      name, len, wire, (double)len / wire, LZ_UART_KBS * len / wire,
+      t_enc, t_dec, c > 0 ? "" : "  (sent plain)");
+}
+
+static void usage(const char *prg) {
+  printf("usage: %s [options]\n", prg);
+  printf("  -f            only run the round trip and corrupt input checks\n");
+  printf("  -n <iters>    check iterations, default 20000\n");
+  printf("  -p <path>     html payload, default ../../../content/cp.html\n");
+}
+
+int main(int argc, char **argv) {
+  int opt;
+  uint8_t checks_only = 0;
+  uint32_t iters = 20000;
+  const char *html = "../../../content/cp.html";
+  while ((opt = getopt(argc, argv, "fn:p:h")) != -1) {
+    switch (opt) {
+    case 'f': checks_only = 1; break;
+    case 'n': iters = strtoul(optarg, NULL, 0); break;
+    case 'p': html = optarg; break;
+    default: usage(argv[0]); return 1;
+    }
+  }
+  srand(1);
+
+  if (check_roundtrip(iters)) return 2;
+  if (check_corrupt(iters * 10)) return 3;
+  printf("hash bits %u: round trip and corrupt input ok, %u iterations\n",
+      CFG_UMAC_LZ_HASH_BITS, iters);
+  if (checks_only) return 0;
+
+  uint8_t d[LZ_PKT_MAX];
+  uint16_t n;
+  if ((n = pl_html(d, html)) > 0) {
+    if (roundtrip(d, n)) return 2;
+    bench("html", d, n, iters);
+  }
+  n = pl_apscan(d);
+  if (roundtrip(d, n)) return 2;
+  bench("apscan", d, n, iters);
+  n = pl_json(d);
+  if (roundtrip(d, n)) return 2;
+  bench("json", d, n, iters);
+  n = pl_rgb(d);
+  if (roundtrip(d, n)) return 2;
+  bench("rgb", d, n, iters);
+  n = pl_random(d);
+  if (roundtrip(d, n)) return 2;
+  bench("random", d, n, iters);
+  return 0;
+}
@@ -0,0 +1,808 @@
+/*
+ * umac_sim.c
+ *
+ * Host simulator of two umac nodes connected by a simulated uart.
+ *
+ * Node a sends packets to node b, which acks them. Both run the real umac
+ * against a virtual clock of one tick per ms. Each direction of the uart
+ * has a tx queue, as the uart ring on target, and a wire moving baud/10
+ * bytes per second with a fixed latency, where bytes may be dropped or
+ * have bits flipped. Payloads carry their id and are verified on receipt.
+ * Optionally, messages are sent through umac_frag instead of packets, or
+ * packets are slip framed, or packets are sent on the bulk lane while short
+ * urgent packets are sent periodically in between.
+ *
+ * Reports goodput, delivery and round trip percentiles, retransmits, the
+ * time from damage on the wire to the next good packet, urgent packet
+ * latency, and the cpu cycles umac spends per byte on each side.
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include "umac.h"
+#include "umac_frag.h"
+
+#define SIM_MAX_PKTS      100000
+#define SIM_RING_SIZE     (1<<20)
+#define SIM_RING_MASK     (SIM_RING_SIZE-1)
+#define SIM_PKT_MAX       UMAC_MAX_LEN
+#define SIM_SEQNOS        16
+#define SIM_FRAG_ID       0xf0
+#define SIM_URGENT_ID     0xf1
+#define SIM_URGENT_LEN    5
+
+typedef struct {
+  uint8_t data[SIM_RING_SIZE];
+  umtick arrival[SIM_RING_SIZE];
+  uint32_t r;
+  uint32_t w;
+} sim_ring;
+
+typedef struct {
+  umac u;
+  uint8_t rx_buf[SIM_PKT_MAX];
+  // bytes queued for the wire towards the peer
+  sim_ring txq;
+  // bytes on the wire, with tick of arrival at the peer
+  sim_ring wire;
+  uint32_t wire_credit;
+  uint8_t timer_on;
+  umtick timer_at;
+  uint64_t cycles;
+  uint64_t cb_cycles;
+  uint64_t tx_bytes;
+  uint64_t rx_bytes;
+} sim_node;
+
+typedef struct {
+  uint32_t id;
+  umtick tick;
+} sim_inflight;
+
+static struct {
+  uint32_t baud;
+  double ber;
+  double drop;
+  umtick latency;
+  umtick jitter;
+  uint32_t pkts;
+  uint16_t len;
+  uint8_t ack;
+  uint8_t frag;
+  uint8_t slip;
+  uint8_t bulk;
+  uint8_t ungated;
+  umtick urgent_period;
+  uint32_t txq_size;
+  uint16_t chunk;
+  uint8_t bytewise;
+  umtick max_ticks;
+  unsigned int seed;
+} cfg = {
+  .baud = 921600,
+  .ber = 0,
+  .drop = 0,
+  .latency = 1,
+  .pkts = 2000,
+  .len = SIM_PKT_MAX,
+  .ack = 1,
+  .txq_size = 2048,
+  .chunk = 64,
+  .max_ticks = 600000,
+  .seed = 1,
+};
+
+static struct {
+  uint32_t sent;
+  uint32_t delivered;
+  uint32_t duplicates;
+  uint32_t corrupt;
+  uint32_t acked;
+  uint32_t timeouts;
+  uint64_t goodput_bytes;
+  uint32_t lat_cnt;
+  uint32_t rtt_cnt;
+  uint32_t rec_cnt;
+  uint32_t zero_timers;
+  uint32_t urgent_sent;
+  uint32_t urgent_delivered;
+  uint32_t urgent_cnt;
+  uint8_t damaged;
+  umtick damage_tick;
+} res;
+
+static umtick now;
+static sim_node node[2];
+static uint8_t tx_data[SIM_SEQNOS][SIM_PKT_MAX];
+static uint8_t tx_data_busy[SIM_SEQNOS];
+static sim_inflight inflight[SIM_SEQNOS];
+static uint8_t delivered[SIM_MAX_PKTS];
+static umtick sent_tick[SIM_MAX_PKTS];
+static uint32_t lat[SIM_MAX_PKTS];
+static uint32_t rtt[SIM_MAX_PKTS];
+static uint32_t rec[SIM_MAX_PKTS];
+static umtick urgent_tick[SIM_MAX_PKTS];
+static uint32_t urgent_lat[SIM_MAX_PKTS];
+static umac_frag frag[2];
+static uint8_t len_check;
+static int32_t len_check_rx;
+static uint8_t msg_data[CFG_UMAC_FRAG_MAX_LEN];
+
+static uint64_t sim_cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __builtin_ia32_rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+static double sim_rand(void) {
+  return (double)rand() / ((double)RAND_MAX + 1.0);
+}
+
+// payload is the id followed by bytes derived from it
+static void sim_fill(uint8_t *d, uint32_t id, uint16_t len) {
+  uint32_t x = id * 2654435761u + 1;
+  uint16_t i;
+  for (i = 0; i < len; i++) {
+    if (i < 4) {
+      d[i] = id >> (24 - i*8);
+    } else {
+      x ^= x << 13;
+      x ^= x >> 17;
+      x ^= x << 5;
+      d[i] = x;
+    }
+  }
+}
+
+static uint32_t sim_ring_used(const sim_ring *r) {
+  return r->w - r->r;
+}
+
+//
+// phy
+//
+
+static void sim_tx_buf(sim_node *n, uint8_t *b, uint16_t len) {
+  n->tx_bytes += len;
+  while (len--) {
+    n->txq.data[n->txq.w++ & SIM_RING_MASK] = *b++;
+  }
+}
+
+// notes the first damage towards the receiver since its last good packet
+static void sim_damage(sim_node *n) {
+  if (n == &node[0] && !res.damaged) {
+    res.damaged = 1;
+    res.damage_tick = now;
+  }
+}
+
+// moves bytes from tx queue onto the wire at baud rate, damaging some
+static void sim_wire_out(sim_node *n) {
+  n->wire_credit += cfg.baud / 10;
+  while (n->wire_credit >= 1000 && sim_ring_used(&n->txq)) {
+    n->wire_credit -= 1000;
+    uint8_t c = n->txq.data[n->txq.r++ & SIM_RING_MASK];
+    if (cfg.drop > 0 && sim_rand() < cfg.drop) {
+      sim_damage(n);
+      continue;
+    }
+    if (cfg.ber > 0) {
+      int b;
+      for (b = 0; b < 8; b++) {
+        if (sim_rand() < cfg.ber) {
+          c ^= 1 << b;
+          sim_damage(n);
+        }
+      }
+    }
+    n->wire.data[n->wire.w & SIM_RING_MASK] = c;
+    n->wire.arrival[n->wire.w & SIM_RING_MASK] = now + cfg.latency;
+    n->wire.w++;
+  }
+  if (sim_ring_used(&n->txq) == 0) n->wire_credit = 0;
+}
+
+// hands arrived bytes to the peer in chunks, as an uart irq would
+static void sim_wire_in(sim_node *n, sim_node *peer) {
+  uint8_t buf[SIM_PKT_MAX];
+  while (sim_ring_used(&n->wire) &&
+      (int32_t)(now - n->wire.arrival[n->wire.r & SIM_RING_MASK]) >= 0) {
+    uint16_t len = 0;
+    while (len < cfg.chunk && sim_ring_used(&n->wire) &&
+        (int32_t)(now - n->wire.arrival[n->wire.r & SIM_RING_MASK]) >= 0) {
+      buf[len++] = n->wire.data[n->wire.r++ & SIM_RING_MASK];
+    }
+    peer->rx_bytes += len;
+    uint64_t t0 = sim_cycles();
+    if (cfg.bytewise) {
+      uint16_t i;
+      for (i = 0; i < len; i++) {
+        umac_report_rx_byte(&peer->u, buf[i]);
+      }
+    } else {
+      umac_report_rx_buf(&peer->u, buf, len);
+    }
+    peer->cycles += sim_cycles() - t0;
+  }
+}
+
+static void sim_timer(sim_node *n, umtick delta) {
+  // freertos timers assert on a zero period
+  if (delta == 0) res.zero_timers++;
+  n->timer_on = 1;
+  n->timer_at = now + delta;
+  // a busy timer task calls late
+  if (cfg.jitter) n->timer_at += rand() % (cfg.jitter + 1);
+}
+
+static void sim_cancel_timer(sim_node *n) {
+  n->timer_on = 0;
+}
+
+static umtick sim_now(void) {
+  return now;
+}
+
+//
+// node a, sender
+//
+
+static void a_timer(umtick delta) { sim_timer(&node[0], delta); }
+static void a_cancel_timer(void) { sim_cancel_timer(&node[0]); }
+static void a_tx_byte(uint8_t c) { sim_tx_buf(&node[0], &c, 1); }
+static void a_tx_buf(uint8_t *b, uint16_t len) { sim_tx_buf(&node[0], b, len); }
+static uint32_t a_tx_pending(void) { return sim_ring_used(&node[0].txq); }
+
+static void a_rx_pkt(umac_pkt *pkt) {
+}
+
+static void a_acked(uint8_t seqno, uint8_t *data, uint16_t len) {
+  if (cfg.frag) {
+    (void)umac_frag_on_ack(&frag[0], seqno);
+    return;
+  }
+  uint64_t t0 = sim_cycles();
+  sim_inflight *f = &inflight[seqno % SIM_SEQNOS];
+  res.acked++;
+  rtt[res.rtt_cnt++] = now - f->tick;
+  node[0].cb_cycles += sim_cycles() - t0;
+}
+
+static void a_timeout(umac_pkt *pkt) {
+  if (cfg.frag) {
+    (void)umac_frag_on_timeout(&frag[0], pkt->seqno);
+    return;
+  }
+  res.timeouts++;
+}
+
+static void a_nonprotocol(uint8_t c) {
+}
+
+static void a_release(uint8_t seqno, const umac_seg *segs, uint8_t nsegs) {
+  int i;
+  for (i = 0; i < SIM_SEQNOS; i++) {
+    if (segs[0].data == tx_data[i]) tx_data_busy[i] = 0;
+  }
+}
+
+static uint8_t *sim_tx_data_alloc(void) {
+  int i;
+  for (i = 0; i < SIM_SEQNOS; i++) {
+    if (!tx_data_busy[i]) {
+      tx_data_busy[i] = 1;
+      return tx_data[i];
+    }
+  }
+  return NULL;
+}
+
+//
+// node b, receiver
+//
+
+static void b_timer(umtick delta) { sim_timer(&node[1], delta); }
+static void b_cancel_timer(void) { sim_cancel_timer(&node[1]); }
+static void b_tx_byte(uint8_t c) { sim_tx_buf(&node[1], &c, 1); }
+static void b_tx_buf(uint8_t *b, uint16_t len) { sim_tx_buf(&node[1], b, len); }
+static uint32_t b_tx_pending(void) { return sim_ring_used(&node[1].txq); }
+
+// verifies a received packet or message
+static void sim_rx(uint8_t *data, uint16_t len) {
+  uint64_t t0 = sim_cycles();
+  static uint8_t ref[CFG_UMAC_FRAG_MAX_LEN];
+  uint32_t id;
+  if (len < 4) goto bad;
+  id = (data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+  if (id >= res.sent) goto bad;
+  sim_fill(ref, id, len);
+  if (memcmp(ref, data, len) != 0) goto bad;
+  if (res.damaged) {
+    res.damaged = 0;
+    if (res.rec_cnt < SIM_MAX_PKTS) rec[res.rec_cnt++] = now - res.damage_tick;
+  }
+  if (delivered[id]) {
+    res.duplicates++;
+  } else {
+    delivered[id] = 1;
+    res.delivered++;
+    res.goodput_bytes += len;
+    lat[res.lat_cnt++] = now - sent_tick[id];
+  }
+  node[1].cb_cycles += sim_cycles() - t0;
+  return;
+bad:
+  res.corrupt++;
+  node[1].cb_cycles += sim_cycles() - t0;
+}
+
+// urgent packets are [SIM_URGENT_ID][index:4]
+static void sim_rx_urgent(uint8_t *data, uint16_t len) {
+  uint32_t ix;
+  if (len != SIM_URGENT_LEN) {
+    res.corrupt++;
+    return;
+  }
+  ix = (data[1] << 24) | (data[2] << 16) | (data[3] << 8) | data[4];
+  if (ix >= res.urgent_sent) {
+    res.corrupt++;
+    return;
+  }
+  res.urgent_delivered++;
+  urgent_lat[res.urgent_cnt++] = now - urgent_tick[ix];
+}
+
+static void b_rx_pkt(umac_pkt *pkt) {
+  if (len_check) {
+    len_check_rx = memcmp(pkt->data, msg_data, pkt->length) == 0 ? pkt->length : -1;
+    return;
+  }
+  if (cfg.urgent_period && pkt->length > 0 && pkt->data[0] == SIM_URGENT_ID) {
+    sim_rx_urgent(pkt->data, pkt->length);
+    return;
+  }
+  if (cfg.frag) {
+    if (pkt->length > 0 && pkt->data[0] == SIM_FRAG_ID) {
+      umac_frag_rx(&frag[1], &pkt->data[1], pkt->length - 1);
+    }
+    return;
+  }
+  sim_rx(pkt->data, pkt->length);
+}
+
+static void b_acked(uint8_t seqno, uint8_t *data, uint16_t len) {
+}
+
+static void b_timeout(umac_pkt *pkt) {
+}
+
+static void b_nonprotocol(uint8_t c) {
+}
+
+//
+// fragmented messages
+//
+
+static int a_frag_tx(const umac_seg *segs, uint8_t nsegs) {
+  return umac_tx_pktv(&node[0].u, 1, segs, nsegs);
+}
+
+static void a_frag_done(uint8_t msgid, int result) {
+  uint32_t id = res.sent - 1;
+  if (result < 0) {
+    res.timeouts++;
+  } else {
+    res.acked++;
+    rtt[res.rtt_cnt++] = now - sent_tick[id];
+  }
+}
+
+static int b_frag_tx(const umac_seg *segs, uint8_t nsegs) {
+  return umac_tx_pktv(&node[1].u, 1, segs, nsegs);
+}
+
+static void b_frag_rx_msg(uint8_t *data, uint16_t len) {
+  sim_rx(data, len);
+}
+
+//
+// traffic
+//
+
+// one message at a time, pumped by acks
+static void sim_send_msg(void) {
+  sim_node *a = &node[0];
+  if (res.sent >= cfg.pkts || frag[0].tx_busy) return;
+  uint32_t id = res.sent;
+  sim_fill(msg_data, id, cfg.len);
+  sent_tick[id] = now;
+  uint64_t t0 = sim_cycles();
+  int msgid = umac_frag_tx(&frag[0], msg_data, cfg.len);
+  a->cycles += sim_cycles() - t0;
+  if (msgid >= 0) res.sent++;
+}
+
+// offers an unsynchronized urgent packet each period, waiting for room in
+// the tx queue as a writer blocking on a full uart ring would
+static void sim_send_urgent(void) {
+  sim_node *a = &node[0];
+  uint8_t d[SIM_URGENT_LEN];
+  if (cfg.urgent_period == 0 || res.sent >= cfg.pkts ||
+      res.urgent_sent >= SIM_MAX_PKTS) return;
+  uint32_t ix = res.urgent_sent;
+  if ((int32_t)(now - ix * cfg.urgent_period) < 0) return;
+  if (sim_ring_used(&a->txq) + SIM_URGENT_LEN + 8 > cfg.txq_size) return;
+  d[0] = SIM_URGENT_ID;
+  d[1] = ix >> 24;
+  d[2] = ix >> 16;
+  d[3] = ix >> 8;
+  d[4] = ix;
+  // latency counts from when the packet was due
+  urgent_tick[ix] = ix * cfg.urgent_period;
+  uint64_t t0 = sim_cycles();
+  (void)umac_tx_pkt(&a->u, 0, d, SIM_URGENT_LEN);
+  a->cycles += sim_cycles() - t0;
+  res.urgent_sent++;
+}
+
+// offers packets while the window and tx queue allows, as a writer blocking
+// on a full uart ring would
+static void sim_send(void) {
+  sim_node *a = &node[0];
+  if (cfg.frag) {
+    sim_send_msg();
+    return;
+  }
+  while (res.sent < cfg.pkts &&
+      sim_ring_used(&a->txq) + cfg.len + 8 <= cfg.txq_size) {
+    uint32_t id = res.sent;
+    uint8_t *d;
+    if (cfg.ack) {
+      if (a->u.await_ack >= CFG_UMAC_TX_WINDOW) break;
+      // held until released by the stack
+      d = sim_tx_data_alloc();
+      if (d == NULL) break;
+    } else {
+      d = tx_data[0];
+    }
+    sim_fill(d, id, cfg.len);
+    sent_tick[id] = now;
+    uint64_t t0 = sim_cycles();
+    int seqno;
+    if (cfg.bulk) {
+      umac_seg seg = { .data = d, .len = cfg.len };
+      seqno = umac_tx_bulk_pktv(&a->u, cfg.ack, &seg, 1);
+    } else {
+      seqno = umac_tx_pkt(&a->u, cfg.ack, d, cfg.len);
+    }
+    a->cycles += sim_cycles() - t0;
+    if (seqno < 0) {
+      if (cfg.ack) a_release(0, &(umac_seg){ .data = d }, 1);
+      break;
+    }
+    if (cfg.ack) {
+      inflight[seqno % SIM_SEQNOS].id = id;
+      inflight[seqno % SIM_SEQNOS].tick = now;
+    }
+    res.sent++;
+  }
+}
+
+static void sim_step(void) {
+  int i;
+  now++;
+  for (i = 0; i < 2; i++) {
+    sim_node *n = &node[i];
+    if (n->timer_on && (int32_t)(now - n->timer_at) >= 0) {
+      n->timer_on = 0;
+      uint64_t t0 = sim_cycles();
+      umac_tick(&n->u);
+      n->cycles += sim_cycles() - t0;
+    }
+  }
+  sim_send_urgent();
+  sim_send();
+  for (i = 0; i < 2; i++) {
+    sim_wire_out(&node[i]);
+  }
+  for (i = 0; i < 2; i++) {
+    sim_wire_in(&node[i], &node[1-i]);
+  }
+}
+
+static int sim_idle(void) {
+  int i;
+  if (res.sent < cfg.pkts) return 0;
+  if (node[0].u.await_ack || frag[0].tx_busy) return 0;
+  for (i = 0; i < 2; i++) {
+    if (sim_ring_used(&node[i].txq) || sim_ring_used(&node[i].wire)) return 0;
+  }
+  return 1;
+}
+
+//
+// crc
+//
+
+static const char *crc_name(void) {
+  switch (CFG_UMAC_CRC) {
+  case UMAC_CRC_COMPACT: return "compact";
+  case UMAC_CRC_TABLE: return "table";
+  case UMAC_CRC_SLICE4: return "slice4";
+  default: return "?";
+  }
+}
+
+static uint16_t ref_crc(uint16_t crc, const uint8_t *d, uint32_t len) {
+  while (len--) {
+    int b;
+    crc ^= *d++ << 8;
+    for (b = 0; b < 8; b++) {
+      crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+// checks the crc engine against a bitwise crc-ccitt on packets as put on
+// the wire, [preamble]<header..payload>[crc_hi][crc_lo]
+static int sim_crc_check(void) {
+  sim_node *a = &node[0];
+  uint8_t pkt[SIM_PKT_MAX + 8];
+  uint16_t len;
+  for (len = 0; len <= SIM_PKT_MAX; len += 1 + len / 8) {
+    sim_fill(tx_data[0], len, len);
+    a->txq.r = a->txq.w;
+    (void)umac_tx_pkt(&a->u, 0, tx_data[0], len);
+    uint32_t n = sim_ring_used(&a->txq);
+    uint32_t i;
+    for (i = 0; i < n && i < sizeof(pkt); i++) {
+      pkt[i] = a->txq.data[(a->txq.r + i) & SIM_RING_MASK];
+    }
+    a->txq.r = a->txq.w;
+    if (n < 4 || n > sizeof(pkt) || pkt[0] != UMAC_PREAMBLE ||
+        ref_crc(0xffff, &pkt[1], n - 3) != ((pkt[n-2] << 8) | pkt[n-1])) {
+      printf("crc %s mismatch at payload length %u\n", crc_name(), len);
+      return -1;
+    }
+  }
+  a->tx_bytes = 0;
+  umac_stats_reset(&a->u);
+  return 0;
+}
+
+//
+// max length
+//
+
+// sends a packet of given length from a to b straight through, returns
+// length received by b, -1 if corrupt, or -2 if refused by a
+static int32_t sim_len_send(uint8_t ack, uint16_t len) {
+  sim_node *a = &node[0];
+  uint8_t buf[SIM_PKT_MAX + 16];
+  sim_fill(msg_data, len, len);
+  a->txq.r = a->txq.w;
+  int res = umac_tx_pkt(&a->u, ack, msg_data, len);
+  uint32_t n = sim_ring_used(&a->txq);
+  uint32_t i;
+  if (res < 0) return n ? -1 : -2;
+  if (n > sizeof(buf)) return -1;
+  for (i = 0; i < n; i++) {
+    buf[i] = a->txq.data[(a->txq.r + i) & SIM_RING_MASK];
+  }
+  a->txq.r = a->txq.w;
+  len_check_rx = -1;
+  umac_report_rx_buf(&node[1].u, buf, n);
+  return len_check_rx;
+}
+
+// the longest payload must pass intact and one byte more must be refused,
+// synchronized or not
+static int sim_len_check(void) {
+  int32_t r768, r769, r769s;
+  len_check = 1;
+  r768 = sim_len_send(0, UMAC_MAX_LEN);
+  r769 = sim_len_send(0, UMAC_MAX_LEN + 1);
+  r769s = sim_len_send(1, UMAC_MAX_LEN + 1);
+  len_check = 0;
+  // drop the acks b sent back
+  node[1].txq.r = node[1].txq.w;
+  node[0].tx_bytes = node[1].tx_bytes = 0;
+  umac_stats_reset(&node[0].u);
+  umac_stats_reset(&node[1].u);
+  if (r768 != UMAC_MAX_LEN || r769 != -2 || r769s != -2 || node[0].u.await_ack) {
+    printf("max length %u: got %i, %u: got %i, synchronized %i\n",
+        UMAC_MAX_LEN, r768, UMAC_MAX_LEN + 1, r769, r769s);
+    return -1;
+  }
+  return 0;
+}
+
+//
+// report
+//
+
+static int cmp_u32(const void *a, const void *b) {
+  uint32_t x = *(const uint32_t *)a;
+  uint32_t y = *(const uint32_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+static void print_pct(const char *name, uint32_t *v, uint32_t cnt) {
+  if (cnt == 0) {
+    printf("%-10s -\n", name);
+    return;
+  }
+  qsort(v, cnt, sizeof(uint32_t), cmp_u32);
+  printf("%-10s p50 %u ms, p99 %u ms, max %u ms\n", name,
+      v[cnt / 2], v[(uint64_t)cnt * 99 / 100], v[cnt - 1]);
+}
+
+static double per_byte(uint64_t cycles, uint64_t bytes) {
+  return bytes ? (double)cycles / bytes : 0;
+}
+
+static void sim_report(void) {
+  umac_stats *sa = &node[0].u.stats;
+  umac_stats *sb = &node[1].u.stats;
+  double secs = now / 1000.0;
+  printf("window %i, crc %s, %u baud, ber %g, drop %g, latency %u ms, rx %u byte chunks%s\n",
+      CFG_UMAC_TX_WINDOW, crc_name(), cfg.baud, cfg.ber, cfg.drop, cfg.latency, cfg.chunk,
+      cfg.bytewise ? ", fed byte by byte" : "");
+  printf("sent       %u %s of %u bytes, %s, %s framed\n", res.sent, cfg.frag ? "msgs" : "pkts",
+      cfg.len, cfg.frag ? "fragmented" : cfg.ack ? "synchronized" : "unsynchronized",
+      cfg.slip ? "slip" : "raw");
+  if (cfg.urgent_period) {
+    printf("urgent     %u pkts of %u bytes every %u ms, %u delivered\n",
+        res.urgent_sent, SIM_URGENT_LEN, cfg.urgent_period, res.urgent_delivered);
+    if (cfg.bulk) {
+      printf("bulk       %u slots, held back over %u pending bytes\n",
+          CFG_UMAC_BULK_SLOTS, CFG_UMAC_BULK_PENDING);
+    } else {
+      printf("bulk       ungated, sent as urgent\n");
+    }
+  }
+  printf("delivered  %u, duplicates %u, corrupt %u, lost %u\n",
+      res.delivered, res.duplicates, res.corrupt, res.sent - res.delivered);
+  printf("goodput    %.1f kB/s over %.2f s\n", secs > 0 ? res.goodput_bytes / secs / 1000 : 0, secs);
+  print_pct("delivery", lat, res.lat_cnt);
+  if (cfg.ack) print_pct("roundtrip", rtt, res.rtt_cnt);
+  if (cfg.ber > 0 || cfg.drop > 0) print_pct("recovery", rec, res.rec_cnt);
+  if (cfg.urgent_period) print_pct("urgent", urgent_lat, res.urgent_cnt);
+  printf("retrans    %u, timeouts %u, crc errors %u, rx timeouts %u, resyncs %u, garbage %u\n",
+      sa->retransmits, sa->timeouts, sb->crc_errors + sa->crc_errors,
+      sb->rx_timeouts + sa->rx_timeouts, sb->rx_resyncs + sa->rx_resyncs,
+      sb->garbage + sa->garbage);
+  printf("cpu        tx %.1f, rx %.1f %s per byte\n",
+      per_byte(node[0].cycles - node[0].cb_cycles, node[0].tx_bytes),
+      per_byte(node[1].cycles - node[1].cb_cycles, node[1].rx_bytes),
+#if defined(__x86_64__) || defined(__i386__)
+      "cycles"
+#else
+      "ns"
+#endif
+      );
+}
+
+static void usage(const char *prg) {
+  printf("usage: %s [options]\n", prg);
+  printf("  -b <baud>     uart baud rate, default %u\n", cfg.baud);
+  printf("  -e <ber>      bit error rate on the wire, default %g\n", cfg.ber);
+  printf("  -d <rate>     byte drop rate on the wire, default %g\n", cfg.drop);
+  printf("  -l <ms>       wire latency, default %u\n", cfg.latency);
+  printf("  -j <ms>       umac_tick up to this late, default %u\n", cfg.jitter);
+  printf("  -n <pkts>     packets to send, max %u, default %u\n", SIM_MAX_PKTS, cfg.pkts);
+  printf("  -s <bytes>    payload length 4..%u, default %u\n", SIM_PKT_MAX, cfg.len);
+  printf("  -u            send unsynchronized packets\n");
+  printf("  -m <bytes>    send fragmented messages of 4..%u bytes instead\n", CFG_UMAC_FRAG_MAX_LEN);
+  printf("  -S            send slip framed packets\n");
+  printf("  -k <ms>       send packets on the bulk lane and an urgent packet every <ms>\n");
+  printf("  -g            with -k, send packets as urgent too rather than bulk\n");
+  printf("  -q <bytes>    sender tx queue size, default %u\n", cfg.txq_size);
+  printf("  -c <bytes>    rx bytes per report, default %u\n", cfg.chunk);
+  printf("  -y            report rx byte by byte rather than as buffers\n");
+  printf("  -r <seed>     random seed, default %u\n", cfg.seed);
+}
+
+int main(int argc, char **argv) {
+  int opt;
+  while ((opt = getopt(argc, argv, "b:e:d:l:j:n:s:um:Sk:gq:c:yr:h")) != -1) {
+    switch (opt) {
+    case 'b': cfg.baud = strtoul(optarg, NULL, 0); break;
+    case 'e': cfg.ber = atof(optarg); break;
+    case 'd': cfg.drop = atof(optarg); break;
+    case 'l': cfg.latency = strtoul(optarg, NULL, 0); break;
+    case 'j': cfg.jitter = strtoul(optarg, NULL, 0); break;
+    case 'n': cfg.pkts = strtoul(optarg, NULL, 0); break;
+    case 's': cfg.len = strtoul(optarg, NULL, 0); break;
+    case 'u': cfg.ack = 0; break;
+    case 'm': cfg.frag = 1; cfg.len = strtoul(optarg, NULL, 0); break;
+    case 'S': cfg.slip = 1; break;
+    case 'k': cfg.urgent_period = strtoul(optarg, NULL, 0); break;
+    case 'g': cfg.ungated = 1; break;
+    case 'q': cfg.txq_size = strtoul(optarg, NULL, 0); break;
+    case 'c': cfg.chunk = strtoul(optarg, NULL, 0); break;
+    case 'y': cfg.bytewise = 1; break;
+    case 'r': cfg.seed = strtoul(optarg, NULL, 0); break;
+    default: usage(argv[0]); return 1;
+    }
+  }
+  if (cfg.pkts > SIM_MAX_PKTS || cfg.len < 4 ||
+      cfg.len > (cfg.frag ? CFG_UMAC_FRAG_MAX_LEN : SIM_PKT_MAX) ||
+      cfg.baud < 10 || cfg.txq_size >= SIM_RING_SIZE ||
+      cfg.chunk < 1 || cfg.chunk > SIM_PKT_MAX ||
+      (cfg.urgent_period && cfg.frag)) {
+    usage(argv[0]);
+    return 1;
+  }
+  cfg.bulk = cfg.urgent_period && !cfg.ungated;
+  srand(cfg.seed);
+
+  umac_cfg ca = {
+      .timer_fn = a_timer,
+      .cancel_timer_fn = a_cancel_timer,
+      .now_fn = sim_now,
+      .tx_byte_fn = a_tx_byte,
+      .tx_buf_fn = a_tx_buf,
+      .rx_pkt_fn = a_rx_pkt,
+      .rx_pkt_ack_fn = a_acked,
+      .timeout_fn = a_timeout,
+      .nonprotocol_data_fn = a_nonprotocol,
+      .tx_release_fn = a_release,
+      .tx_pending_fn = a_tx_pending,
+  };
+  umac_cfg cb = {
+      .timer_fn = b_timer,
+      .cancel_timer_fn = b_cancel_timer,
+      .now_fn = sim_now,
+      .tx_byte_fn = b_tx_byte,
+      .tx_buf_fn = b_tx_buf,
+      .rx_pkt_fn = b_rx_pkt,
+      .rx_pkt_ack_fn = b_acked,
+      .timeout_fn = b_timeout,
+      .nonprotocol_data_fn = b_nonprotocol,
+      .tx_pending_fn = b_tx_pending,
+  };
+  umac_init(&node[0].u, &ca, node[0].rx_buf);
+  umac_init(&node[1].u, &cb, node[1].rx_buf);
+  umac_frag_cfg fa = {
+      .tx_fn = a_frag_tx,
+      .tx_done_fn = a_frag_done,
+      .container_id = SIM_FRAG_ID
+  };
+  umac_frag_cfg fb = {
+      .tx_fn = b_frag_tx,
+      .rx_msg_fn = b_frag_rx_msg,
+      .container_id = SIM_FRAG_ID
+  };
+  umac_frag_init(&frag[0], &fa);
+  umac_frag_init(&frag[1], &fb);
+
+  if (sim_crc_check()) return 3;
+  if (sim_len_check()) return 5;
+  if (cfg.slip) {
+    umac_set_framing(&node[0].u, UMAC_FRAMING_SLIP);
+    umac_set_framing(&node[1].u, UMAC_FRAMING_SLIP);
+  }
+
+  while (!sim_idle() && now < cfg.max_ticks) {
+    sim_step();
+  }
+  sim_report();
+  // a clean link must deliver everything intact
+  if (cfg.ber == 0 && cfg.drop == 0 && (res.corrupt || res.delivered != res.sent)) return 2;
+  if (res.zero_timers) {
+    printf("timer requested %u times with zero delta\n", res.zero_timers);
+    return 4;
+  }
+  return 0;
+}
@@ -9,8 +9,165 @@
 
 #define UMAC_INIT_CRC      0xffff
 
+#ifdef CFG_UMAC_STATS
+#define STAT_INC(u, x)     (u)->stats.x++
+#define STAT_ADD(u, x, n)  (u)->stats.x += (n)
+#define STAT_NACK(u, x, e) (u)->stats.x[(e) < UMAC_NACK_ERRS ? (e) : 0]++
+#else
+#define STAT_INC(u, x)
+#define STAT_ADD(u, x, n)
+#define STAT_NACK(u, x, e)
+#endif
+
 static void _umac_request_rx_timer(umac *u, umtick delta);
 static void _umac_request_ack_timer(umac *u, umtick delta);
+static void _umac_cancel_ack_timer(umac *u);
+
+#if CFG_UMAC_CRC == UMAC_CRC_TABLE || CFG_UMAC_CRC == UMAC_CRC_SLICE4
+// CRC-CCITT16, poly 0x1021, msb first
+static const uint16_t _crc_tab0[256] = {
+  0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+  0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
+  0x1231, 0x0210, 0x3273, 0x2252, 0x52b5, 0x4294, 0x72f7, 0x62d6,
+  0x9339, 0x8318, 0xb37b, 0xa35a, 0xd3bd, 0xc39c, 0xf3ff, 0xe3de,
+  0x2462, 0x3443, 0x0420, 0x1401, 0x64e6, 0x74c7, 0x44a4, 0x5485,
+  0xa56a, 0xb54b, 0x8528, 0x9509, 0xe5ee, 0xf5cf, 0xc5ac, 0xd58d,
+  0x3653, 0x2672, 0x1611, 0x0630, 0x76d7, 0x66f6, 0x5695, 0x46b4,
+  0xb75b, 0xa77a, 0x9719, 0x8738, 0xf7df, 0xe7fe, 0xd79d, 0xc7bc,
+  0x48c4, 0x58e5, 0x6886, 0x78a7, 0x0840, 0x1861, 0x2802, 0x3823,
+  0xc9cc, 0xd9ed, 0xe98e, 0xf9af, 0x8948, 0x9969, 0xa90a, 0xb92b,
+  0x5af5, 0x4ad4, 0x7ab7, 0x6a96, 0x1a71, 0x0a50, 0x3a33, 0x2a12,
+  0xdbfd, 0xcbdc, 0xfbbf, 0xeb9e, 0x9b79, 0x8b58, 0xbb3b, 0xab1a,
+  0x6ca6, 0x7c87, 0x4ce4, 0x5cc5, 0x2c22, 0x3c03, 0x0c60, 0x1c41,
+  0xedae, 0xfd8f, 0xcdec, 0xddcd, 0xad2a, 0xbd0b, 0x8d68, 0x9d49,
+  0x7e97, 0x6eb6, 0x5ed5, 0x4ef4, 0x3e13, 0x2e32, 0x1e51, 0x0e70,
+  0xff9f, 0xefbe, 0xdfdd, 0xcffc, 0xbf1b, 0xaf3a, 0x9f59, 0x8f78,
+  0x9188, 0x81a9, 0xb1ca, 0xa1eb, 0xd10c, 0xc12d, 0xf14e, 0xe16f,
+  0x1080, 0x00a1, 0x30c2, 0x20e3, 0x5004, 0x4025, 0x7046, 0x6067,
+  0x83b9, 0x9398, 0xa3fb, 0xb3da, 0xc33d, 0xd31c, 0xe37f, 0xf35e,
+  0x02b1, 0x1290, 0x22f3, 0x32d2, 0x4235, 0x5214, 0x6277, 0x7256,
+  0xb5ea, 0xa5cb, 0x95a8, 0x8589, 0xf56e, 0xe54f, 0xd52c, 0xc50d,
+  0x34e2, 0x24c3, 0x14a0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+  0xa7db, 0xb7fa, 0x8799, 0x97b8, 0xe75f, 0xf77e, 0xc71d, 0xd73c,
+  0x26d3, 0x36f2, 0x0691, 0x16b0, 0x6657, 0x7676, 0x4615, 0x5634,
+  0xd94c, 0xc96d, 0xf90e, 0xe92f, 0x99c8, 0x89e9, 0xb98a, 0xa9ab,
+  0x5844, 0x4865, 0x7806, 0x6827, 0x18c0, 0x08e1, 0x3882, 0x28a3,
+  0xcb7d, 0xdb5c, 0xeb3f, 0xfb1e, 0x8bf9, 0x9bd8, 0xabbb, 0xbb9a,
+  0x4a75, 0x5a54, 0x6a37, 0x7a16, 0x0af1, 0x1ad0, 0x2ab3, 0x3a92,
+  0xfd2e, 0xed0f, 0xdd6c, 0xcd4d, 0xbdaa, 0xad8b, 0x9de8, 0x8dc9,
+  0x7c26, 0x6c07, 0x5c64, 0x4c45, 0x3ca2, 0x2c83, 0x1ce0, 0x0cc1,
+  0xef1f, 0xff3e, 0xcf5d, 0xdf7c, 0xaf9b, 0xbfba, 0x8fd9, 0x9ff8,
+  0x6e17, 0x7e36, 0x4e55, 0x5e74, 0x2e93, 0x3eb2, 0x0ed1, 0x1ef0
+};
+#endif
+
+#if CFG_UMAC_CRC == UMAC_CRC_SLICE4
+// _crc_tabN[i] = crc of byte i followed by N zero bytes
+static const uint16_t _crc_tab1[256] = {
+  0x0000, 0x3331, 0x6662, 0x5553, 0xccc4, 0xfff5, 0xaaa6, 0x9997,
+  0x89a9, 0xba98, 0xefcb, 0xdcfa, 0x456d, 0x765c, 0x230f, 0x103e,
+  0x0373, 0x3042, 0x6511, 0x5620, 0xcfb7, 0xfc86, 0xa9d5, 0x9ae4,
+  0x8ada, 0xb9eb, 0xecb8, 0xdf89, 0x461e, 0x752f, 0x207c, 0x134d,
+  0x06e6, 0x35d7, 0x6084, 0x53b5, 0xca22, 0xf913, 0xac40, 0x9f71,
+  0x8f4f, 0xbc7e, 0xe92d, 0xda1c, 0x438b, 0x70ba, 0x25e9, 0x16d8,
+  0x0595, 0x36a4, 0x63f7, 0x50c6, 0xc951, 0xfa60, 0xaf33, 0x9c02,
+  0x8c3c, 0xbf0d, 0xea5e, 0xd96f, 0x40f8, 0x73c9, 0x269a, 0x15ab,
+  0x0dcc, 0x3efd, 0x6bae, 0x589f, 0xc108, 0xf239, 0xa76a, 0x945b,
+  0x8465, 0xb754, 0xe207, 0xd136, 0x48a1, 0x7b90, 0x2ec3, 0x1df2,
+  0x0ebf, 0x3d8e, 0x68dd, 0x5bec, 0xc27b, 0xf14a, 0xa419, 0x9728,
+  0x8716, 0xb427, 0xe174, 0xd245, 0x4bd2, 0x78e3, 0x2db0, 0x1e81,
+  0x0b2a, 0x381b, 0x6d48, 0x5e79, 0xc7ee, 0xf4df, 0xa18c, 0x92bd,
+  0x8283, 0xb1b2, 0xe4e1, 0xd7d0, 0x4e47, 0x7d76, 0x2825, 0x1b14,
+  0x0859, 0x3b68, 0x6e3b, 0x5d0a, 0xc49d, 0xf7ac, 0xa2ff, 0x91ce,
+  0x81f0, 0xb2c1, 0xe792, 0xd4a3, 0x4d34, 0x7e05, 0x2b56, 0x1867,
+  0x1b98, 0x28a9, 0x7dfa, 0x4ecb, 0xd75c, 0xe46d, 0xb13e, 0x820f,
+  0x9231, 0xa100, 0xf453, 0xc762, 0x5ef5, 0x6dc4, 0x3897, 0x0ba6,
+  0x18eb, 0x2bda, 0x7e89, 0x4db8, 0xd42f, 0xe71e, 0xb24d, 0x817c,
+  0x9142, 0xa273, 0xf720, 0xc411, 0x5d86, 0x6eb7, 0x3be4, 0x08d5,
+  0x1d7e, 0x2e4f, 0x7b1c, 0x482d, 0xd1ba, 0xe28b, 0xb7d8, 0x84e9,
+  0x94d7, 0xa7e6, 0xf2b5, 0xc184, 0x5813, 0x6b22, 0x3e71, 0x0d40,
+  0x1e0d, 0x2d3c, 0x786f, 0x4b5e, 0xd2c9, 0xe1f8, 0xb4ab, 0x879a,
+  0x97a4, 0xa495, 0xf1c6, 0xc2f7, 0x5b60, 0x6851, 0x3d02, 0x0e33,
+  0x1654, 0x2565, 0x7036, 0x4307, 0xda90, 0xe9a1, 0xbcf2, 0x8fc3,
+  0x9ffd, 0xaccc, 0xf99f, 0xcaae, 0x5339, 0x6008, 0x355b, 0x066a,
+  0x1527, 0x2616, 0x7345, 0x4074, 0xd9e3, 0xead2, 0xbf81, 0x8cb0,
+  0x9c8e, 0xafbf, 0xfaec, 0xc9dd, 0x504a, 0x637b, 0x3628, 0x0519,
+  0x10b2, 0x2383, 0x76d0, 0x45e1, 0xdc76, 0xef47, 0xba14, 0x8925,
+  0x991b, 0xaa2a, 0xff79, 0xcc48, 0x55df, 0x66ee, 0x33bd, 0x008c,
+  0x13c1, 0x20f0, 0x75a3, 0x4692, 0xdf05, 0xec34, 0xb967, 0x8a56,
+  0x9a68, 0xa959, 0xfc0a, 0xcf3b, 0x56ac, 0x659d, 0x30ce, 0x03ff
+};
+static const uint16_t _crc_tab2[256] = {
+  0x0000, 0x3730, 0x6e60, 0x5950, 0xdcc0, 0xebf0, 0xb2a0, 0x8590,
+  0xa9a1, 0x9e91, 0xc7c1, 0xf0f1, 0x7561, 0x4251, 0x1b01, 0x2c31,
+  0x4363, 0x7453, 0x2d03, 0x1a33, 0x9fa3, 0xa893, 0xf1c3, 0xc6f3,
+  0xeac2, 0xddf2, 0x84a2, 0xb392, 0x3602, 0x0132, 0x5862, 0x6f52,
+  0x86c6, 0xb1f6, 0xe8a6, 0xdf96, 0x5a06, 0x6d36, 0x3466, 0x0356,
+  0x2f67, 0x1857, 0x4107, 0x7637, 0xf3a7, 0xc497, 0x9dc7, 0xaaf7,
+  0xc5a5, 0xf295, 0xabc5, 0x9cf5, 0x1965, 0x2e55, 0x7705, 0x4035,
+  0x6c04, 0x5b34, 0x0264, 0x3554, 0xb0c4, 0x87f4, 0xdea4, 0xe994,
+  0x1dad, 0x2a9d, 0x73cd, 0x44fd, 0xc16d, 0xf65d, 0xaf0d, 0x983d,
+  0xb40c, 0x833c, 0xda6c, 0xed5c, 0x68cc, 0x5ffc, 0x06ac, 0x319c,
+  0x5ece, 0x69fe, 0x30ae, 0x079e, 0x820e, 0xb53e, 0xec6e, 0xdb5e,
+  0xf76f, 0xc05f, 0x990f, 0xae3f, 0x2baf, 0x1c9f, 0x45cf, 0x72ff,
+  0x9b6b, 0xac5b, 0xf50b, 0xc23b, 0x47ab, 0x709b, 0x29cb, 0x1efb,
+  0x32ca, 0x05fa, 0x5caa, 0x6b9a, 0xee0a, 0xd93a, 0x806a, 0xb75a,
+  0xd808, 0xef38, 0xb668, 0x8158, 0x04c8, 0x33f8, 0x6aa8, 0x5d98,
+  0x71a9, 0x4699, 0x1fc9, 0x28f9, 0xad69, 0x9a59, 0xc309, 0xf439,
+  0x3b5a, 0x0c6a, 0x553a, 0x620a, 0xe79a, 0xd0aa, 0x89fa, 0xbeca,
+  0x92fb, 0xa5cb, 0xfc9b, 0xcbab, 0x4e3b, 0x790b, 0x205b, 0x176b,
+  0x7839, 0x4f09, 0x1659, 0x2169, 0xa4f9, 0x93c9, 0xca99, 0xfda9,
+  0xd198, 0xe6a8, 0xbff8, 0x88c8, 0x0d58, 0x3a68, 0x6338, 0x5408,
+  0xbd9c, 0x8aac, 0xd3fc, 0xe4cc, 0x615c, 0x566c, 0x0f3c, 0x380c,
+  0x143d, 0x230d, 0x7a5d, 0x4d6d, 0xc8fd, 0xffcd, 0xa69d, 0x91ad,
+  0xfeff, 0xc9cf, 0x909f, 0xa7af, 0x223f, 0x150f, 0x4c5f, 0x7b6f,
+  0x575e, 0x606e, 0x393e, 0x0e0e, 0x8b9e, 0xbcae, 0xe5fe, 0xd2ce,
+  0x26f7, 0x11c7, 0x4897, 0x7fa7, 0xfa37, 0xcd07, 0x9457, 0xa367,
+  0x8f56, 0xb866, 0xe136, 0xd606, 0x5396, 0x64a6, 0x3df6, 0x0ac6,
+  0x6594, 0x52a4, 0x0bf4, 0x3cc4, 0xb954, 0x8e64, 0xd734, 0xe004,
+  0xcc35, 0xfb05, 0xa255, 0x9565, 0x10f5, 0x27c5, 0x7e95, 0x49a5,
+  0xa031, 0x9701, 0xce51, 0xf961, 0x7cf1, 0x4bc1, 0x1291, 0x25a1,
+  0x0990, 0x3ea0, 0x67f0, 0x50c0, 0xd550, 0xe260, 0xbb30, 0x8c00,
+  0xe352, 0xd462, 0x8d32, 0xba02, 0x3f92, 0x08a2, 0x51f2, 0x66c2,
+  0x4af3, 0x7dc3, 0x2493, 0x13a3, 0x9633, 0xa103, 0xf853, 0xcf63
+};
+static const uint16_t _crc_tab3[256] = {
+  0x0000, 0x76b4, 0xed68, 0x9bdc, 0xcaf1, 0xbc45, 0x2799, 0x512d,
+  0x85c3, 0xf377, 0x68ab, 0x1e1f, 0x4f32, 0x3986, 0xa25a, 0xd4ee,
+  0x1ba7, 0x6d13, 0xf6cf, 0x807b, 0xd156, 0xa7e2, 0x3c3e, 0x4a8a,
+  0x9e64, 0xe8d0, 0x730c, 0x05b8, 0x5495, 0x2221, 0xb9fd, 0xcf49,
+  0x374e, 0x41fa, 0xda26, 0xac92, 0xfdbf, 0x8b0b, 0x10d7, 0x6663,
+  0xb28d, 0xc439, 0x5fe5, 0x2951, 0x787c, 0x0ec8, 0x9514, 0xe3a0,
+  0x2ce9, 0x5a5d, 0xc181, 0xb735, 0xe618, 0x90ac, 0x0b70, 0x7dc4,
+  0xa92a, 0xdf9e, 0x4442, 0x32f6, 0x63db, 0x156f, 0x8eb3, 0xf807,
+  0x6e9c, 0x1828, 0x83f4, 0xf540, 0xa46d, 0xd2d9, 0x4905, 0x3fb1,
+  0xeb5f, 0x9deb, 0x0637, 0x7083, 0x21ae, 0x571a, 0xccc6, 0xba72,
+  0x753b, 0x038f, 0x9853, 0xeee7, 0xbfca, 0xc97e, 0x52a2, 0x2416,
+  0xf0f8, 0x864c, 0x1d90, 0x6b24, 0x3a09, 0x4cbd, 0xd761, 0xa1d5,
+  0x59d2, 0x2f66, 0xb4ba, 0xc20e, 0x9323, 0xe597, 0x7e4b, 0x08ff,
+  0xdc11, 0xaaa5, 0x3179, 0x47cd, 0x16e0, 0x6054, 0xfb88, 0x8d3c,
+  0x4275, 0x34c1, 0xaf1d, 0xd9a9, 0x8884, 0xfe30, 0x65ec, 0x1358,
+  0xc7b6, 0xb102, 0x2ade, 0x5c6a, 0x0d47, 0x7bf3, 0xe02f, 0x969b,
+  0xdd38, 0xab8c, 0x3050, 0x46e4, 0x17c9, 0x617d, 0xfaa1, 0x8c15,
+  0x58fb, 0x2e4f, 0xb593, 0xc327, 0x920a, 0xe4be, 0x7f62, 0x09d6,
+  0xc69f, 0xb02b, 0x2bf7, 0x5d43, 0x0c6e, 0x7ada, 0xe106, 0x97b2,
+  0x435c, 0x35e8, 0xae34, 0xd880, 0x89ad, 0xff19, 0x64c5, 0x1271,
+  0xea76, 0x9cc2, 0x071e, 0x71aa, 0x2087, 0x5633, 0xcdef, 0xbb5b,
+  0x6fb5, 0x1901, 0x82dd, 0xf469, 0xa544, 0xd3f0, 0x482c, 0x3e98,
+  0xf1d1, 0x8765, 0x1cb9, 0x6a0d, 0x3b20, 0x4d94, 0xd648, 0xa0fc,
+  0x7412, 0x02a6, 0x997a, 0xefce, 0xbee3, 0xc857, 0x538b, 0x253f,
+  0xb3a4, 0xc510, 0x5ecc, 0x2878, 0x7955, 0x0fe1, 0x943d, 0xe289,
+  0x3667, 0x40d3, 0xdb0f, 0xadbb, 0xfc96, 0x8a22, 0x11fe, 0x674a,
+  0xa803, 0xdeb7, 0x456b, 0x33df, 0x62f2, 0x1446, 0x8f9a, 0xf92e,
+  0x2dc0, 0x5b74, 0xc0a8, 0xb61c, 0xe731, 0x9185, 0x0a59, 0x7ced,
+  0x84ea, 0xf25e, 0x6982, 0x1f36, 0x4e1b, 0x38af, 0xa373, 0xd5c7,
+  0x0129, 0x779d, 0xec41, 0x9af5, 0xcbd8, 0xbd6c, 0x26b0, 0x5004,
+  0x9f4d, 0xe9f9, 0x7225, 0x0491, 0x55bc, 0x2308, 0xb8d4, 0xce60,
+  0x1a8e, 0x6c3a, 0xf7e6, 0x8152, 0xd07f, 0xa6cb, 0x3d17, 0x4ba3
+};
+#endif
+
+#if CFG_UMAC_CRC == UMAC_CRC_COMPACT
 
 static inline unsigned short _crc_ccitt_16(unsigned short crc, unsigned char data) {
   crc  = (unsigned char)(crc >> 8) | (crc << 8);
@@ -21,21 +178,40 @@ static inline unsigned short _crc_ccitt_16(unsigned short crc, unsigned char dat
   return crc;
 }
 
+#else
+
+static inline unsigned short _crc_ccitt_16(unsigned short crc, unsigned char data) {
+  return (unsigned short)((crc << 8) ^ _crc_tab0[(unsigned char)(crc >> 8) ^ data]);
+}
+
+#endif
+
 static uint16_t _crc_buf(uint16_t initial, uint8_t *data, uint16_t len) {
   uint16_t crc = initial;
+#if CFG_UMAC_CRC == UMAC_CRC_SLICE4
+  while (len >= 4) {
+    crc = _crc_tab3[(crc >> 8) ^ data[0]] ^
+          _crc_tab2[(crc & 0xff) ^ data[1]] ^
+          _crc_tab1[data[2]] ^
+          _crc_tab0[data[3]];
+    data += 4;
+    len -= 4;
+  }
+#endif
   while (len--) {
     crc = _crc_ccitt_16(crc, *data++);
   }
   return crc;
 }
 
-// starts system timer
+// starts system timer, an overdue timer fires on next tick as some timer
+// implementations refuse a zero period
 static void _umac_hal_set_timer(umac *u, umtick delta) {
   if (u->timer_enabled) {
     u->cfg.cancel_timer_fn();
   }
   u->timer_enabled = 1;
-  u->cfg.timer_fn(delta);
+  u->cfg.timer_fn(delta > 0 ? delta : 1);
 }
 
 // stops system timer
@@ -46,15 +222,69 @@ static void _umac_hal_disable_timer(umac *u) {
   u->timer_enabled = 0;
 }
 
-// increases tx seqno
+// increases tx seqno, skipping seqnos still awaiting ack
 static void _umac_inc_tx_seqno(umac *u) {
-  u->tx_seqno++;
-  if (u->tx_seqno > 0xf) u->tx_seqno = 1;
+  uint8_t i;
+  do {
+    u->tx_seqno++;
+    if (u->tx_seqno > 0xf) u->tx_seqno = 1;
+    for (i = 0; i < CFG_UMAC_TX_WINDOW; i++) {
+      if (u->tx_slots[i].busy && u->tx_slots[i].pkt.seqno == u->tx_seqno) break;
+    }
+  } while (i < CFG_UMAC_TX_WINDOW);
+}
+
+// finds the slot of an outstanding synchronous packet
+static umac_tx_slot *_umac_find_tx_slot(umac *u, uint8_t seqno) {
+  uint8_t i;
+  for (i = 0; i < CFG_UMAC_TX_WINDOW; i++) {
+    if (u->tx_slots[i].busy && u->tx_slots[i].pkt.seqno == seqno) {
+      return &u->tx_slots[i];
+    }
+  }
+  return NULL;
+}
+
+#ifdef CFG_UMAC_SLIP
+static const uint8_t _slip_end = UMAC_SLIP_END;
+static const uint8_t _slip_esc_end[2] = { UMAC_SLIP_ESC, UMAC_SLIP_ESC_END };
+static const uint8_t _slip_esc_esc[2] = { UMAC_SLIP_ESC, UMAC_SLIP_ESC_ESC };
+
+// transmit bytes to PHY, byte stuffed if slip framing
+static void _umac_phy_tx(umac *u, const uint8_t *b, uint16_t len) {
+  if (u->tx_framing != UMAC_FRAMING_SLIP) {
+    u->cfg.tx_buf_fn((uint8_t *)b, len);
+    return;
+  }
+  const uint8_t *run = b;
+  while (len--) {
+    uint8_t c = *b;
+    if (c == UMAC_SLIP_END || c == UMAC_SLIP_ESC) {
+      if (b > run) u->cfg.tx_buf_fn((uint8_t *)run, b - run);
+      u->cfg.tx_buf_fn((uint8_t *)(c == UMAC_SLIP_END ? _slip_esc_end : _slip_esc_esc), 2);
+      run = b + 1;
+    }
+    b++;
+  }
+  if (b > run) u->cfg.tx_buf_fn((uint8_t *)run, b - run);
 }
 
+// transmit frame delimiter if slip framing. Only a leading delimiter is sent,
+// so the receiver is back in raw mode after each packet
+static void _umac_phy_delim(umac *u) {
+  if (u->tx_framing == UMAC_FRAMING_SLIP) {
+    u->cfg.tx_buf_fn((uint8_t *)&_slip_end, 1);
+  }
+}
+#else
+#define _umac_phy_tx(u, b, l) (u)->cfg.tx_buf_fn((uint8_t *)(b), (l))
+#define _umac_phy_delim(u)
+#endif
+
 // transmit a NACK with error code
 static void _umac_tx_nack(umac *u, uint8_t err, uint8_t seqno) {
   CFG_UMAC_DBG("RX: NACK seq %x: err %i\n", seqno, err);
+  STAT_NACK(u, tx_nacks, err);
   u->tmp[0] = UMAC_PREAMBLE;
   u->tmp[1] = (UMAC_PKT_NACK << 6) | ((seqno & 0xf) << 2) | (1);
   u->tmp[2] = 0x00;
@@ -62,7 +292,8 @@ static void _umac_tx_nack(umac *u, uint8_t err, uint8_t seqno) {
   uint16_t crc = _crc_buf(UMAC_INIT_CRC, &u->tmp[1], 3);
   u->tmp[4] = crc >> 8;
   u->tmp[5] = crc;
-  u->cfg.tx_buf_fn(u->tmp, 6);
+  _umac_phy_delim(u);
+  _umac_phy_tx(u, u->tmp, 6);
 }
 
 // transmit an empty ACK
@@ -73,41 +304,132 @@ static void _umac_tx_ack_empty(umac *u, uint8_t seqno) {
   uint16_t crc = _crc_buf(UMAC_INIT_CRC, &u->tmp[1], 1);
   u->tmp[2] = crc >> 8;
   u->tmp[3] = crc;
-  u->cfg.tx_buf_fn(u->tmp, 4);
+  _umac_phy_delim(u);
+  _umac_phy_tx(u, u->tmp, 4);
 }
 
-// transmit a general packet only
-static void _umac_tx(umac *u, umac_pkt *pkt) {
-  CFG_UMAC_DBG("TX: seq %i, %s\n", pkt->seqno, pkt->pkt_type == UMAC_PKT_NREQ_ACK ? "unsync" : "sync");
+// transmit a general packet with payload gathered from segments
+static void _umac_tx_v(umac *u, umac_pkt_type type, uint8_t seqno,
+    const umac_seg *segs, uint8_t nsegs, uint16_t length) {
+  CFG_UMAC_DBG("TX: seq %i, %s\n", seqno, type == UMAC_PKT_NREQ_ACK ? "unsync" : "sync");
+  STAT_INC(u, tx_pkts);
+  STAT_ADD(u, tx_bytes, length);
   uint16_t crc;
   u->tmp[0] = UMAC_PREAMBLE;
-  uint16_t hlen = pkt->length == 0 ? 0 : (((((pkt->length-1)>>8) + 1) << 8) | (pkt->length - 1));
-  u->tmp[1] = (pkt->pkt_type << 6) | ((pkt->seqno & 0xf) << 2) | (hlen >> 8);
+  uint16_t hlen = length == 0 ? 0 : (((((length-1)>>8) + 1) << 8) | ((length - 1) & 0xff));
+  u->tmp[1] = (type << 6) | ((seqno & 0xf) << 2) | (hlen >> 8);
+  _umac_phy_delim(u);
   if (hlen == 0) {
     crc = _crc_buf(UMAC_INIT_CRC, &u->tmp[1], 1);
     u->tmp[2] = crc >> 8;
     u->tmp[3] = crc;
-    u->cfg.tx_buf_fn(u->tmp, 4);
+    _umac_phy_tx(u, u->tmp, 4);
   } else {
     u->tmp[2] = hlen & 0xff;
     crc = _crc_buf(UMAC_INIT_CRC, &u->tmp[1], 2);
-    u->cfg.tx_buf_fn(u->tmp, 3);
-    crc = _crc_buf(crc, pkt->data, pkt->length);
-    u->cfg.tx_buf_fn(pkt->data, pkt->length);
+    _umac_phy_tx(u, u->tmp, 3);
+    while (nsegs--) {
+      if (segs->len) {
+        crc = _crc_buf(crc, (uint8_t *)segs->data, segs->len);
+        _umac_phy_tx(u, segs->data, segs->len);
+      }
+      segs++;
+    }
     u->tmp[0] = crc >> 8;
     u->tmp[1] = crc;
-    u->cfg.tx_buf_fn(u->tmp, 2);
+    _umac_phy_tx(u, u->tmp, 2);
   }
 }
 
-// transmit a general packet and request ack timer if necessary
-static void _umac_tx_initial(umac *u, umac_pkt *pkt) {
-  _umac_tx(u, pkt);
-  if (pkt->pkt_type == UMAC_PKT_REQ_ACK) {
-    u->retry_ctr = 0;
-    u->await_ack = 1;
-    _umac_request_ack_timer(u, CFG_UMAC_RETRY_DELTA(u->retry_ctr));
+// transmit a general packet only
+static void _umac_tx(umac *u, umac_pkt *pkt) {
+  umac_seg seg = { .data = pkt->data, .len = pkt->length };
+  _umac_tx_v(u, pkt->pkt_type, pkt->seqno, &seg, 1, pkt->length);
+}
+
+// sum length of segments
+static uint32_t _umac_segs_len(const umac_seg *segs, uint8_t nsegs) {
+  uint32_t len = 0;
+  while (nsegs--) {
+    len += (segs++)->len;
   }
+  return len;
+}
+
+// mark a synchronous packet slot as free
+static void _umac_tx_free_slot(umac *u, umac_tx_slot *s) {
+  s->busy = 0;
+  u->await_ack--;
+  if (s->bulk) u->await_bulk--;
+}
+
+// hand back a released synchronous packet to user, s is a copy of the freed
+// slot, so a single segment is taken from the copy as the slot may be reused
+static void _umac_tx_release(umac *u, umac_tx_slot *s) {
+  if (u->cfg.tx_release_fn) {
+    u->cfg.tx_release_fn(s->pkt.seqno, s->nsegs == 1 ? &s->seg : s->segs, s->nsegs);
+  }
+}
+
+#ifdef CFG_UMAC_ADAPTIVE_RTO
+// update rtt estimates and retransmit timeout with a new round trip sample
+static void _umac_rtt_sample(umac *u, umtick rtt) {
+  if (!u->rtt_valid) {
+    u->srtt = rtt << 3;
+    u->rttvar = rtt << 1;
+    u->rtt_valid = 1;
+  } else {
+    int32_t err = (int32_t)rtt - (int32_t)(u->srtt >> 3);
+    u->srtt += err;
+    if (err < 0) err = -err;
+    u->rttvar += err - (int32_t)(u->rttvar >> 2);
+  }
+  umtick rto = (u->srtt >> 3) + u->rttvar;
+  if (rto < CFG_UMAC_RTO_MIN) rto = CFG_UMAC_RTO_MIN;
+  if (rto > CFG_UMAC_RTO_MAX) rto = CFG_UMAC_RTO_MAX;
+  u->rto = rto;
+}
+
+// retransmit timeout for given try, exponential backoff
+static umtick _umac_retry_delta(umac *u, uint8_t try) {
+  umtick d = u->rto;
+  while (try-- && d < CFG_UMAC_RTO_MAX) {
+    d <<= 1;
+  }
+  if (d > CFG_UMAC_RTO_MAX) d = CFG_UMAC_RTO_MAX;
+  return d;
+}
+#else
+#define _umac_retry_delta(u, try) CFG_UMAC_RETRY_DELTA(try)
+#endif
+
+// rearm ack timer to the nearest retransmit of all outstanding packets
+static void _umac_ack_timer_update(umac *u, umtick now) {
+  uint8_t i;
+  uint8_t found = 0;
+  umtick nearest = 0;
+  for (i = 0; i < CFG_UMAC_TX_WINDOW; i++) {
+    umac_tx_slot *s = &u->tx_slots[i];
+    if (!s->busy) continue;
+    umtick d = now - s->tx_tick;
+    umtick left = d >= s->retry_delta ? 0 : s->retry_delta - d;
+    if (!found || left < nearest) {
+      nearest = left;
+      found = 1;
+    }
+  }
+  if (found) {
+    _umac_request_ack_timer(u, nearest);
+  } else {
+    _umac_cancel_ack_timer(u);
+  }
+}
+
+// transmit a synchronous packet from given slot and schedule retransmit
+static void _umac_tx_slot(umac *u, umac_tx_slot *s, umtick now) {
+  _umac_tx_v(u, s->pkt.pkt_type, s->pkt.seqno, s->segs, s->nsegs, s->pkt.length);
+  s->tx_tick = now;
+  s->retry_delta = _umac_retry_delta(u, s->retry_ctr);
 }
 
 // adjust active timers from now
@@ -210,50 +532,90 @@ static void _umac_cancel_ack_timer(umac *u) {
 
 // timer ack triggered
 static void _umac_timer_trig_ack(umac *u) {
-  if (u->await_ack) {
-    u->retry_ctr++;
-    if (u->retry_ctr > CFG_UMAC_RETRIES) {
-      CFG_UMAC_DBG("TX: noACK, TMO seq %i\n", u->tx_seqno);
-      _umac_inc_tx_seqno(u);
-      u->retry_ctr = 0;
-      u->await_ack = 0;
-      u->cfg.timeout_fn(&u->tx_pkt);
+  uint8_t i;
+  umtick now = u->cfg.now_fn();
+  for (i = 0; i < CFG_UMAC_TX_WINDOW; i++) {
+    umac_tx_slot *s = &u->tx_slots[i];
+    if (!s->busy || now - s->tx_tick < s->retry_delta) continue;
+    s->retry_ctr++;
+    if (s->retry_ctr > CFG_UMAC_RETRIES) {
+      CFG_UMAC_DBG("TX: noACK, TMO seq %i\n", s->pkt.seqno);
+      STAT_INC(u, timeouts);
+      umac_tx_slot rel = *s;
+      _umac_tx_free_slot(u, s);
+      u->cfg.timeout_fn(&rel.pkt);
+      _umac_tx_release(u, &rel);
     } else {
-      CFG_UMAC_DBG("TX: noACK, reTX seq %i, #%i\n", u->tx_seqno, u->retry_ctr);
-      _umac_tx(u, &u->tx_pkt);
-      _umac_request_ack_timer(u, CFG_UMAC_RETRY_DELTA(u->retry_ctr));
+      CFG_UMAC_DBG("TX: noACK, reTX seq %i, #%i\n", s->pkt.seqno, s->retry_ctr);
+      s->rtt_sample = 0; // ambiguous ack, do not sample (Karn)
+      STAT_INC(u, retransmits);
+      _umac_tx_slot(u, s, now);
     }
   }
+  _umac_ack_timer_update(u, u->cfg.now_fn());
 }
 
 // timer rx triggered
 static void _umac_timer_trig_rx(umac *u) {
   CFG_UMAC_DBG("RX: pkt TMO\n");
+  STAT_INC(u, rx_timeouts);
   _umac_tx_nack(u, UMAC_NACK_ERR_RX_TIMEOUT, u->rx_pkt.seqno);
   u->rx_state = UMST_RX_EXP_PREAMBLE;
+#ifdef CFG_UMAC_SLIP
+  u->rx_slip = UMAC_SLIP_RX_RAW;
+#endif
 }
 
+#ifdef CFG_UMAC_STATS
+// count ack latency in power of two buckets
+static void _umac_stat_ack_lat(umac *u, umtick lat) {
+  uint8_t b = 0;
+  while (lat > 1 && b < UMAC_STATS_LAT_BUCKETS - 1) {
+    lat >>= 1;
+    b++;
+  }
+  u->stats.ack_lat[b]++;
+}
+#endif
+
 // trigger packet reception, auto ack if required and user didn't call reply in callback
 static void _umac_trig_rx_pkt(umac *u) {
+  umac_tx_slot *s;
+  STAT_INC(u, rx_pkts);
+  STAT_ADD(u, rx_bytes, u->rx_pkt.length);
   switch (u->rx_pkt.pkt_type) {
   case UMAC_PKT_ACK:
-    if (u->await_ack && u->tx_seqno == u->rx_pkt.seqno) {
+    if ((s = _umac_find_tx_slot(u, u->rx_pkt.seqno)) != NULL) {
       CFG_UMAC_DBG("RX: ACK seq %i\n", u->rx_pkt.seqno);
-      _umac_cancel_ack_timer(u);
-      u->await_ack = 0;
-      _umac_inc_tx_seqno(u);
+#ifdef CFG_UMAC_ADAPTIVE_RTO
+      if (s->rtt_sample) {
+        _umac_rtt_sample(u, u->cfg.now_fn() - s->tx_tick);
+      }
+#endif
+#ifdef CFG_UMAC_STATS
+      _umac_stat_ack_lat(u, u->cfg.now_fn() - s->first_tick);
+#endif
+      umac_tx_slot rel = *s;
+      _umac_tx_free_slot(u, s);
+      _umac_ack_timer_update(u, u->cfg.now_fn());
       u->cfg.rx_pkt_ack_fn(u->rx_pkt.seqno, u->rx_pkt.data, u->rx_pkt.length);
+      _umac_tx_release(u, &rel);
     } else {
       CFG_UMAC_DBG("RX: ACK unkn seq %i\n", u->rx_pkt.seqno);
     }
     break;
   case UMAC_PKT_NACK:
-    if (u->await_ack && u->tx_seqno == u->rx_pkt.seqno) {
+    STAT_NACK(u, rx_nacks, u->rx_pkt.data[0]);
+    if ((s = _umac_find_tx_slot(u, u->rx_pkt.seqno)) != NULL) {
       if (u->rx_pkt.data[0] == UMAC_NACK_ERR_BAD_CRC ||
           u->rx_pkt.data[0] == UMAC_NACK_ERR_RX_TIMEOUT) {
         CFG_UMAC_DBG("RX: NACK seq %i, err %i, reTX direct\n", u->rx_pkt.seqno, u->rx_pkt.data[0]);
-        _umac_cancel_ack_timer(u);
-        _umac_tx_initial(u, &u->tx_pkt);
+        umtick now = u->cfg.now_fn();
+        s->retry_ctr = 0;
+        s->rtt_sample = 0;
+        STAT_INC(u, retransmits);
+        _umac_tx_slot(u, s, now);
+        _umac_ack_timer_update(u, now);
       } else {
         CFG_UMAC_DBG("RX: NACK seq %i, err %i\n", u->rx_pkt.seqno, u->rx_pkt.data[0]);
       }
@@ -274,6 +636,8 @@ static void _umac_trig_rx_pkt(umac *u) {
       // auto ack
       _umac_tx_ack_empty(u, rx_seqno);
     }
+    // user might have replied, which borrows rx_pkt
+    u->rx_pkt.data = u->rx_buf;
     break;
   }
   }
@@ -289,6 +653,12 @@ static void _umac_parse_char(umac *u, uint8_t c) {
       u->rx_state = UMST_RX_EXP_HDR_HI;
     } else {
       u->rx_state = UMST_RX_NOT_PREAMBLE;
+#ifdef CFG_UMAC_SLIP
+      // a delimiter not followed by a packet was garbage too, stay raw or
+      // raw packets would be cut at any delimiter value in their payload
+      u->rx_slip = UMAC_SLIP_RX_RAW;
+#endif
+      STAT_INC(u, garbage);
       if (u->cfg.nonprotocol_data_fn) {
         u->cfg.nonprotocol_data_fn(c);
       }
@@ -303,6 +673,7 @@ static void _umac_parse_char(umac *u, uint8_t c) {
       _umac_request_rx_timer(u, CFG_UMAC_RX_TIMEOUT);
       u->rx_state = UMST_RX_EXP_HDR_HI;
     } else {
+      STAT_INC(u, garbage);
       if (u->cfg.nonprotocol_data_fn) {
         u->cfg.nonprotocol_data_fn(c);
       }
@@ -316,7 +687,7 @@ static void _umac_parse_char(umac *u, uint8_t c) {
     u->rx_state = u->rx_pkt.length == 0 ? UMST_RX_CRC_HI : UMST_RX_EXP_HDR_LO;
     break;
   case UMST_RX_EXP_HDR_LO:
-    u->rx_pkt.length = ((u->rx_pkt.length - 1) << 8) | (c + 1);
+    u->rx_pkt.length = ((u->rx_pkt.length - 1) << 8) + c + 1;
     u->rx_local_crc = _crc_ccitt_16(u->rx_local_crc, c);
     u->rx_data_cnt = 0;
     u->rx_state = UMST_RX_DATA;
@@ -336,21 +707,59 @@ static void _umac_parse_char(umac *u, uint8_t c) {
     _umac_cancel_rx_timer(u);
     u->rx_pkt.crc |= c;
     if (u->rx_pkt.crc != u->rx_local_crc) {
+      STAT_INC(u, crc_errors);
       _umac_tx_nack(u, UMAC_NACK_ERR_BAD_CRC, u->rx_pkt.seqno);
     } else {
       _umac_trig_rx_pkt(u);
     }
     u->rx_state = UMST_RX_EXP_PREAMBLE;
+#ifdef CFG_UMAC_SLIP
+    u->rx_slip = UMAC_SLIP_RX_RAW;
+#endif
     break;
   }
 }
 
+#ifdef CFG_UMAC_SLIP
+// parse an rx char, unstuffing slip frames. A slip frame is recognized by a
+// frame delimiter between packets, so raw and slip framed packets can be mixed.
+static void _umac_rx_char(umac *u, uint8_t c) {
+  if (c == UMAC_SLIP_END &&
+      (u->rx_slip != UMAC_SLIP_RX_RAW ||
+       u->rx_state == UMST_RX_EXP_PREAMBLE || u->rx_state == UMST_RX_NOT_PREAMBLE)) {
+    if (u->rx_state != UMST_RX_EXP_PREAMBLE && u->rx_state != UMST_RX_NOT_PREAMBLE) {
+      // delimiter within packet, drop it and resync right away
+      CFG_UMAC_DBG("RX: slip resync\n");
+      STAT_INC(u, rx_resyncs);
+      _umac_cancel_rx_timer(u);
+    }
+    u->rx_state = UMST_RX_EXP_PREAMBLE;
+    u->rx_slip = UMAC_SLIP_RX_FRAME;
+    return;
+  }
+  if (u->rx_slip == UMAC_SLIP_RX_ESC) {
+    c = c == UMAC_SLIP_ESC_END ? UMAC_SLIP_END : (c == UMAC_SLIP_ESC_ESC ? UMAC_SLIP_ESC : c);
+    u->rx_slip = UMAC_SLIP_RX_FRAME;
+  } else if (u->rx_slip == UMAC_SLIP_RX_FRAME && c == UMAC_SLIP_ESC) {
+    u->rx_slip = UMAC_SLIP_RX_ESC;
+    return;
+  }
+  _umac_parse_char(u, c);
+}
+#else
+#define _umac_rx_char(u, c) _umac_parse_char(u, c)
+#endif
+
 
 void umac_init(umac *u, umac_cfg *cfg, uint8_t *rx_buffer) {
   memset(u, 0, sizeof(umac));
   memcpy(&u->cfg, cfg, sizeof(umac_cfg));
   u->rx_pkt.data = rx_buffer;
+  u->rx_buf = rx_buffer;
   u->tx_seqno = 1;
+#ifdef CFG_UMAC_ADAPTIVE_RTO
+  u->rto = CFG_UMAC_RTO_INIT;
+#endif
 }
 
 void umac_tick(umac *u) {
@@ -376,22 +785,73 @@ void umac_tick(umac *u) {
   }
 }
 
-int umac_tx_pkt(umac *u, uint8_t ack, uint8_t *buf, uint16_t len) {
-  if (u->await_ack && ack) {
+static int _umac_tx_pktv(umac *u, uint8_t ack, uint8_t bulk,
+    const umac_seg *segs, uint8_t nsegs) {
+  if (u->await_ack >= CFG_UMAC_TX_WINDOW && ack) {
     CFG_UMAC_DBG("TX: ERR user send sync while BUSY\n");
     return -1; // TODO busy, some error
   }
-  if (len > 769) {
+  uint32_t len = _umac_segs_len(segs, nsegs);
+  if (len > UMAC_MAX_LEN) {
     CFG_UMAC_DBG("TX: ERR too long\n");
     return -1;
   }
-  umac_pkt *pkt = &u->tx_pkt;
-  pkt->pkt_type = ack ? UMAC_PKT_REQ_ACK : UMAC_PKT_NREQ_ACK;
-  pkt->data = buf;
-  pkt->length = len;
-  pkt->seqno = ack ? u->tx_seqno : 0;
-  _umac_tx_initial(u, pkt);
-  return pkt->seqno;
+  if (!ack) {
+    _umac_tx_v(u, UMAC_PKT_NREQ_ACK, 0, segs, nsegs, len);
+    return 0;
+  }
+  uint8_t i;
+  umac_tx_slot *s = NULL;
+  for (i = 0; i < CFG_UMAC_TX_WINDOW; i++) {
+    if (!u->tx_slots[i].busy) {
+      s = &u->tx_slots[i];
+      break;
+    }
+  }
+  if (nsegs == 1) {
+    // keep own copy of a single segment, user need only keep the data
+    s->seg = segs[0];
+    segs = &s->seg;
+  }
+  s->segs = segs;
+  s->nsegs = nsegs;
+  s->pkt.pkt_type = UMAC_PKT_REQ_ACK;
+  s->pkt.data = nsegs > 0 ? (uint8_t *)segs[0].data : NULL;
+  s->pkt.length = len;
+  s->pkt.seqno = u->tx_seqno;
+  s->retry_ctr = 0;
+  s->rtt_sample = 1;
+  s->bulk = bulk;
+  s->busy = 1;
+  u->await_ack++;
+  if (bulk) u->await_bulk++;
+  _umac_inc_tx_seqno(u);
+  umtick now = u->cfg.now_fn();
+#ifdef CFG_UMAC_STATS
+  s->first_tick = now;
+#endif
+  _umac_tx_slot(u, s, now);
+  _umac_ack_timer_update(u, now);
+  return s->pkt.seqno;
+}
+
+int umac_tx_pktv(umac *u, uint8_t ack, const umac_seg *segs, uint8_t nsegs) {
+  return _umac_tx_pktv(u, ack, 0, segs, nsegs);
+}
+
+int umac_tx_bulk_pktv(umac *u, uint8_t ack, const umac_seg *segs, uint8_t nsegs) {
+  if (ack && u->await_bulk >= CFG_UMAC_BULK_SLOTS) {
+    return UMAC_ERR_BULK_BUSY;
+  }
+  if (u->cfg.tx_pending_fn && u->cfg.tx_pending_fn() > CFG_UMAC_BULK_PENDING) {
+    return UMAC_ERR_BULK_BUSY;
+  }
+  return _umac_tx_pktv(u, ack, 1, segs, nsegs);
+}
+
+int umac_tx_pkt(umac *u, uint8_t ack, uint8_t *buf, uint16_t len) {
+  umac_seg seg = { .data = buf, .len = len };
+  return umac_tx_pktv(u, ack, &seg, 1);
 }
 
 int umac_tx_reply_ack(umac *u, uint8_t *buf, uint16_t len) {
@@ -399,7 +859,7 @@ int umac_tx_reply_ack(umac *u, uint8_t *buf, uint16_t len) {
     CFG_UMAC_DBG("TX: ERR user send ack wrong state\n");
     return -1; // TODO not within rx call, some error
   }
-  if (len > 769) {
+  if (len > UMAC_MAX_LEN) {
     CFG_UMAC_DBG("TX: ERR too long\n");
     return -1;
   }
@@ -408,16 +868,60 @@ int umac_tx_reply_ack(umac *u, uint8_t *buf, uint16_t len) {
   u->rx_pkt.pkt_type = UMAC_PKT_ACK;
   u->rx_pkt.data = buf;
   u->rx_pkt.length = len;
-  _umac_tx_initial(u, &u->rx_pkt);
+  _umac_tx(u, &u->rx_pkt);
   return 0;
 }
 
 void umac_report_rx_byte(umac *u, uint8_t c) {
-  _umac_parse_char(u, c);
+  _umac_rx_char(u, c);
 }
 
 void umac_report_rx_buf(umac *u, uint8_t *buf, uint16_t len) {
-  while (len--) {
-    _umac_parse_char(u, *buf++);
+  while (len) {
+    if (u->rx_state == UMST_RX_DATA) {
+      // fast path, grab as much payload as possible in one go
+      uint16_t chunk = u->rx_pkt.length - u->rx_data_cnt;
+      if (chunk > len) chunk = len;
+#ifdef CFG_UMAC_SLIP
+      if (u->rx_slip != UMAC_SLIP_RX_RAW) {
+        // only up to next slip special char
+        uint16_t i = 0;
+        if (u->rx_slip == UMAC_SLIP_RX_FRAME) {
+          for (; i < chunk; i++) {
+            if (buf[i] == UMAC_SLIP_END || buf[i] == UMAC_SLIP_ESC) break;
+          }
+        }
+        chunk = i;
+        if (chunk == 0) {
+          _umac_rx_char(u, *buf++);
+          len--;
+          continue;
+        }
+      }
+#endif
+      memcpy(&u->rx_pkt.data[u->rx_data_cnt], buf, chunk);
+      u->rx_local_crc = _crc_buf(u->rx_local_crc, buf, chunk);
+      u->rx_data_cnt += chunk;
+      if (u->rx_data_cnt >= u->rx_pkt.length) {
+        u->rx_state = UMST_RX_CRC_HI;
+      }
+      buf += chunk;
+      len -= chunk;
+    } else {
+      _umac_rx_char(u, *buf++);
+      len--;
+    }
   }
 }
+
+#ifdef CFG_UMAC_SLIP
+void umac_set_framing(umac *u, umac_framing framing) {
+  u->tx_framing = framing;
+}
+#endif
+
+#ifdef CFG_UMAC_STATS
+void umac_stats_reset(umac *u) {
+  memset(&u->stats, 0, sizeof(umac_stats));
+}
+#endif
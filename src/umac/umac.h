@@ -10,8 +10,16 @@
  * The stack handles retransmits automatically. Unless user acks packets herself, the
  * stack auto-acks if necessary. Acks can be piggybacked with payload data.
  *
- * Only one synchronized packed can be in the air at a time. It is legal to send unsynched
- * packets while a synchronized is not yet acked, though.
+ * The stack keeps no time of its own. All timing is derived from now_fn, and umac_tick
+ * is expected once the delta requested by timer_fn has elapsed. Hence, umac can be run
+ * off target against a virtual clock by advancing now_fn and calling umac_tick when due,
+ * as the host simulator in sim/ does.
+ * The stack only needs what umac_cfg.h provides, i.e. uint8_t et al, memcpy and memset.
+ *
+ * Up to CFG_UMAC_TX_WINDOW synchronized packets can be in the air at a time, each with
+ * its own seqno and retransmit timer. Acks are selective, i.e. each packet is acked by
+ * its own seqno. With a window of 1 (default), this is the classic stop-and-wait. It is
+ * legal to send unsynched packets while synchronized are not yet acked, though.
  *
  *  Created on: Feb 15, 2016
  *      Author: petera
@@ -42,6 +50,9 @@
     [PREAMBLE][TySeqnLd]([DatLen  ][]..[])[CrcHi   ][CrcLo   ]
 
     For packets requiring ack (PKT_REQ), the seqno increments from 1..15.
+    Seqnos of packets still awaiting ack are skipped. Note that with a tx window
+    larger than 1, a receiver cannot detect resent packets by only comparing
+    with the last received seqno.
     For packets not requiring ack (PKT_NREQ), the seqno is 0.
     An ACK or NACK keeps the seqno of the packet being acked or nacked, if known.
     If unknown, 0x0 is used as seqno.
@@ -68,23 +79,108 @@
 #define CFG_UMAC_RETRY_DELTA(try)    40
 #endif
 
+/* If CFG_UMAC_ADAPTIVE_RTO is defined, the retransmit timeout is derived from
+   smoothed round trip time and variance of acked packets as for TCP (RFC 6298),
+   doubled for each retry and kept within CFG_UMAC_RTO_MIN..CFG_UMAC_RTO_MAX.
+   Otherwise, CFG_UMAC_RETRY_DELTA is used. */
+#ifdef CFG_UMAC_ADAPTIVE_RTO
+
+#ifndef CFG_UMAC_RTO_MIN
+#define CFG_UMAC_RTO_MIN             2
+#endif
+
+#ifndef CFG_UMAC_RTO_MAX
+#define CFG_UMAC_RTO_MAX             4*CFG_UMAC_RETRY_DELTA(1)
+#endif
+
+#ifndef CFG_UMAC_RTO_INIT
+#define CFG_UMAC_RTO_INIT            CFG_UMAC_RETRY_DELTA(0)
+#endif
+
+#endif
+
 #ifndef CFG_UMAC_RX_TIMEOUT
 #define CFG_UMAC_RX_TIMEOUT          2*CFG_UMAC_RETRY_DELTA(1)*CFG_UMAC_RETRIES
 #endif
 
+#ifndef CFG_UMAC_TX_WINDOW
+#define CFG_UMAC_TX_WINDOW           1
+#endif
+
+#if CFG_UMAC_TX_WINDOW < 1 || CFG_UMAC_TX_WINDOW > 7
+#error CFG_UMAC_TX_WINDOW must be within 1..7
+#endif
+
 #ifndef CFG_UMAC_TICK_TYPE
 #define CFG_UMAC_TICK_TYPE           uint32_t
 #endif
 
+/* Number of window slots synchronized bulk packets may occupy, the rest are
+   kept for urgent packets */
+#ifndef CFG_UMAC_BULK_SLOTS
+#define CFG_UMAC_BULK_SLOTS          (CFG_UMAC_TX_WINDOW > 1 ? CFG_UMAC_TX_WINDOW - 1 : 1)
+#endif
+
+/* Bulk packets are held back while more than this many bytes are queued
+   in the PHY layer, see tx_pending_fn */
+#ifndef CFG_UMAC_BULK_PENDING
+#define CFG_UMAC_BULK_PENDING        128
+#endif
+
+/* Max payload length, datlen + 1 + 512 with len_def 3 */
+#define UMAC_MAX_LEN                 768
+
+#define UMAC_ERR_BULK_BUSY           -2
+
+/* CRC engines, select with CFG_UMAC_CRC
+     UMAC_CRC_COMPACT : bit twiddling per byte, no tables
+     UMAC_CRC_TABLE   : 256 entry table, 512 bytes const
+     UMAC_CRC_SLICE4  : four 256 entry tables, 2048 bytes const, 4 bytes per lookup */
+#define UMAC_CRC_COMPACT             0
+#define UMAC_CRC_TABLE               1
+#define UMAC_CRC_SLICE4              2
+
+#ifndef CFG_UMAC_CRC
+#define CFG_UMAC_CRC                 UMAC_CRC_COMPACT
+#endif
+
 #define UMAC_PREAMBLE                0xfd
 
+/* If CFG_UMAC_SLIP is defined, packets may be sent SLIP framed, see
+   umac_set_framing. Each packet is then preceded by END and any END or ESC
+   within is escaped. A receiver recognizes slip framed packets by
+   itself and resyncs at the next END after garbage or lost bytes,
+   instead of waiting for CFG_UMAC_RX_TIMEOUT. */
+#define UMAC_SLIP_END                0xc0
+#define UMAC_SLIP_ESC                0xdb
+#define UMAC_SLIP_ESC_END            0xdc
+#define UMAC_SLIP_ESC_ESC            0xdd
+
 #define UMAC_NACK_ERR_NOT_PREAMBLE   0x01
 #define UMAC_NACK_ERR_BAD_CRC        0x02
 #define UMAC_NACK_ERR_RX_TIMEOUT     0x03
 #define UMAC_NACK_ERR_NOT_READY      0x04
+#define UMAC_NACK_ERRS               5
+
+/* If CFG_UMAC_STATS is defined, the umac struct keeps counters in
+   member stats. Ack latency is counted from first transmit of a
+   synchronized packet until its ack, in power of two buckets:
+   ack_lat[0] <2 ticks, ack_lat[1] <4 ticks, ..., ack_lat[N-1] the rest. */
+#define UMAC_STATS_LAT_BUCKETS       8
 
 typedef CFG_UMAC_TICK_TYPE umtick;
 
+typedef enum {
+  UMAC_FRAMING_RAW = 0,
+  UMAC_FRAMING_SLIP
+} umac_framing;
+
+typedef enum {
+  UMAC_SLIP_RX_RAW = 0,
+  UMAC_SLIP_RX_FRAME,
+  UMAC_SLIP_RX_ESC
+} umac_slip_rx_state;
+
 typedef enum {
   UMAC_PKT_NREQ_ACK = 0,
   UMAC_PKT_REQ_ACK,
@@ -110,6 +206,44 @@ typedef struct {
   uint16_t crc;
 } umac_pkt;
 
+typedef struct {
+  const uint8_t *data;
+  uint16_t len;
+} umac_seg;
+
+typedef struct {
+  umac_pkt pkt;
+  const umac_seg *segs;
+  uint8_t nsegs;
+  umac_seg seg;
+  uint8_t busy;
+  uint8_t retry_ctr;
+  uint8_t rtt_sample; // set until resent, ack then gives rtt sample
+  uint8_t bulk;
+  umtick tx_tick;
+#ifdef CFG_UMAC_STATS
+  umtick first_tick;
+#endif
+  umtick retry_delta;
+} umac_tx_slot;
+
+typedef struct {
+  uint32_t tx_pkts;
+  uint32_t tx_bytes;
+  uint32_t rx_pkts;
+  uint32_t rx_bytes;
+  uint32_t retransmits;
+  uint32_t timeouts;
+  uint32_t rx_timeouts;
+  uint32_t crc_errors;
+  uint32_t garbage;
+  uint32_t rx_resyncs; // slip framed packets cut short by a delimiter
+  // indexed by nack error code, 0 for unknown codes
+  uint32_t tx_nacks[UMAC_NACK_ERRS];
+  uint32_t rx_nacks[UMAC_NACK_ERRS];
+  uint32_t ack_lat[UMAC_STATS_LAT_BUCKETS];
+} umac_stats;
+
 typedef void (* umac_request_future_tick)(umtick delta_tick);
 typedef void (* umac_cancel_future_tick)(void);
 typedef umtick (* umac_now_tick)(void);
@@ -119,9 +253,11 @@ typedef void (* umac_rx_pkt)(umac_pkt *pkt);
 typedef void (* umac_tx_pkt_acked)(uint8_t seqno, uint8_t *data, uint16_t len);
 typedef void (* umac_timeout)(umac_pkt *pkt);
 typedef void (* umac_nonprotocol_data)(uint8_t c);
+typedef void (* umac_tx_release)(uint8_t seqno, const umac_seg *segs, uint8_t nsegs);
+typedef uint32_t (* umac_tx_pending)(void);
 
 typedef struct {
-  /** Requests that umac_tick is to be called within given ticks */
+  /** Requests that umac_tick is to be called within given ticks, never 0 */
   umac_request_future_tick timer_fn;
   /** Cancel any previous request to call umac_tick */
   umac_cancel_future_tick cancel_timer_fn;
@@ -139,23 +275,40 @@ typedef struct {
   umac_timeout timeout_fn;
   /** Called if non protocol data is received */
   umac_nonprotocol_data nonprotocol_data_fn;
+  /** Optional, called when a synchronous packet is acked or timed out and
+      its buffers are no longer referenced by the stack */
+  umac_tx_release tx_release_fn;
+  /** Optional, returns number of bytes queued in the PHY layer that are not
+      yet on the wire. Used to keep urgent packets from queueing behind bulk */
+  umac_tx_pending tx_pending_fn;
 } umac_cfg;
 
 typedef struct {
   umac_cfg cfg;
   umac_rx_state rx_state;
   uint8_t tmp[8];
+#ifdef CFG_UMAC_SLIP
+  umac_framing tx_framing;
+  umac_slip_rx_state rx_slip;
+#endif
 
   umac_pkt rx_pkt;
+  uint8_t *rx_buf;
 
   uint16_t rx_data_cnt;
   uint16_t rx_local_crc;
   uint8_t rx_user_acked;
   uint8_t tx_seqno;
 
-  umac_pkt tx_pkt;
+  umac_tx_slot tx_slots[CFG_UMAC_TX_WINDOW];
   uint8_t await_ack;
-  uint8_t retry_ctr;
+  uint8_t await_bulk;
+#ifdef CFG_UMAC_ADAPTIVE_RTO
+  uint8_t rtt_valid;
+  uint32_t srtt;   // smoothed rtt, scaled by 8
+  uint32_t rttvar; // rtt variance, scaled by 4
+  umtick rto;
+#endif
 
   uint8_t timer_enabled;
   uint8_t timer_ack_enabled;
@@ -164,6 +317,9 @@ typedef struct {
   uint8_t timer_rx_enabled;
   umtick timer_rx_delta;
   umtick timer_rx_start_tick;
+#ifdef CFG_UMAC_STATS
+  umac_stats stats;
+#endif
 } umac;
 
 /**
@@ -177,14 +333,40 @@ void umac_init(umac *u, umac_cfg *cfg, uint8_t *rx_buffer);
  */
 void umac_tick(umac *u);
 /**
- * Transmits a packet.
+ * Transmits a packet. If ack is set, the packet is synchronized and
+ * buf must be kept intact until the packet is acked or timed out.
+ * Returns the seqno for synchronized packets, 0 for unsynchronized,
+ * or -1 if CFG_UMAC_TX_WINDOW synchronized packets are already in
+ * the air.
  */
 int umac_tx_pkt(umac *u, uint8_t ack, uint8_t *buf, uint16_t len);
+/**
+ * Transmits a packet whose payload is gathered from nsegs segments,
+ * without copying. Returns as umac_tx_pkt.
+ * For synchronized packets, the segments' data must be kept intact until
+ * tx_release_fn is called for the packet. If more than one segment is
+ * given, this also goes for the segs array itself.
+ * In timeout_fn, the packet data points to the first segment only, while
+ * the length is the total length.
+ */
+int umac_tx_pktv(umac *u, uint8_t ack, const umac_seg *segs, uint8_t nsegs);
+/**
+ * Like umac_tx_pktv, but for bulk traffic that may be delayed in favour of
+ * urgent packets sent with umac_tx_pkt(v). Synchronized bulk packets never
+ * occupy more than CFG_UMAC_BULK_SLOTS window slots, and any bulk packet is
+ * held back while the PHY layer has more than CFG_UMAC_BULK_PENDING bytes
+ * queued. This way an urgent packet waits for at most one bulk packet on
+ * the wire.
+ * Returns UMAC_ERR_BULK_BUSY if the packet is held back, the caller should
+ * try again later. Otherwise as umac_tx_pktv.
+ */
+int umac_tx_bulk_pktv(umac *u, uint8_t ack, const umac_seg *segs, uint8_t nsegs);
 /**
  * When a synchronous packet is received, umac_rx_pkt rx_pkt_fn
  * in config struct is called. In this call, user may ack with
  * piggybacked data if wanted. If not, the stack autoacks with an
- * empty ack.
+ * empty ack. The ack is sent right away, so buf need not be kept
+ * after return.
  */
 int umac_tx_reply_ack(umac *u,  uint8_t *buf, uint16_t len);
 
@@ -194,7 +376,25 @@ int umac_tx_reply_ack(umac *u,  uint8_t *buf, uint16_t len);
 void umac_report_rx_byte(umac *u, uint8_t c);
 /**
  * Report to stack that a buffer was received from PHY.
+ * Payload data is copied and checksummed in bulk, so prefer
+ * this over umac_report_rx_byte when having many bytes at hand.
  */
 void umac_report_rx_buf(umac *u, uint8_t *buf, uint16_t len);
 
+#ifdef CFG_UMAC_SLIP
+/**
+ * Sets framing for transmitted packets. Received packets are accepted
+ * in any framing. Both sides should agree on slip before using it, as
+ * an older receiver will not understand it.
+ */
+void umac_set_framing(umac *u, umac_framing framing);
+#endif
+
+#ifdef CFG_UMAC_STATS
+/**
+ * Zeroes all statistics counters.
+ */
+void umac_stats_reset(umac *u);
+#endif
+
 #endif /* _UMAC_H_ */
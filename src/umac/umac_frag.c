@@ -0,0 +1,145 @@
+/*
+ * umac_frag.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#include "umac_frag.h"
+
+// finish current tx message if nothing more is in the air
+static void _umac_frag_tx_finish(umac_frag *f) {
+  int i;
+  for (i = 0; i < CFG_UMAC_TX_WINDOW; i++) {
+    if (f->tx_inflight[i].seqno) return;
+  }
+  if (!f->tx_failed && f->tx_acked < f->tx_frags) return;
+  f->tx_busy = 0;
+  if (f->cfg.tx_done_fn) {
+    f->cfg.tx_done_fn(f->tx_msgid, f->tx_failed ? -1 : 0);
+  }
+}
+
+// send as many pending fragments as the window allows
+static void _umac_frag_tx_pump(umac_frag *f) {
+  int i;
+  for (i = 0; i < CFG_UMAC_TX_WINDOW; i++) {
+    if (!f->tx_busy || f->tx_failed || f->tx_next_ix >= f->tx_frags) return;
+    umac_frag_inflight *fl = &f->tx_inflight[i];
+    if (fl->seqno) continue;
+    uint16_t ix = f->tx_next_ix;
+    uint32_t offs = (uint32_t)ix * UMAC_FRAG_DATA_LEN;
+    uint16_t len = f->tx_len - offs > UMAC_FRAG_DATA_LEN ?
+        UMAC_FRAG_DATA_LEN : f->tx_len - offs;
+    fl->hdr[0] = f->cfg.container_id;
+    fl->hdr[1] = f->tx_msgid;
+    fl->hdr[2] = (ix >> 8) | (ix == f->tx_frags - 1 ? UMAC_FRAG_LAST : 0);
+    fl->hdr[3] = ix;
+    fl->segs[0].data = fl->hdr;
+    fl->segs[0].len = UMAC_FRAG_HDR_LEN;
+    fl->segs[1].data = &f->tx_data[offs];
+    fl->segs[1].len = len;
+    int res = f->cfg.tx_fn(fl->segs, 2);
+    if (res <= 0) return; // window full, retry on next ack
+    fl->seqno = res;
+    f->tx_next_ix++;
+  }
+}
+
+static umac_frag_inflight *_umac_frag_find(umac_frag *f, uint8_t seqno) {
+  int i;
+  if (seqno == 0) return 0;
+  for (i = 0; i < CFG_UMAC_TX_WINDOW; i++) {
+    if (f->tx_inflight[i].seqno == seqno) return &f->tx_inflight[i];
+  }
+  return 0;
+}
+
+void umac_frag_init(umac_frag *f, umac_frag_cfg *cfg) {
+  memset(f, 0, sizeof(umac_frag));
+  memcpy(&f->cfg, cfg, sizeof(umac_frag_cfg));
+}
+
+int umac_frag_tx(umac_frag *f, const uint8_t *data, uint16_t len) {
+  if (f->tx_busy || len == 0 || len > CFG_UMAC_FRAG_MAX_LEN) return -1;
+  f->tx_data = data;
+  f->tx_len = len;
+  f->tx_frags = (len + UMAC_FRAG_DATA_LEN - 1) / UMAC_FRAG_DATA_LEN;
+  f->tx_next_ix = 0;
+  f->tx_acked = 0;
+  f->tx_failed = 0;
+  f->tx_msgid++;
+  f->tx_busy = 1;
+  _umac_frag_tx_pump(f);
+  return f->tx_msgid;
+}
+
+int umac_frag_on_ack(umac_frag *f, uint8_t seqno) {
+  umac_frag_inflight *fl = _umac_frag_find(f, seqno);
+  if (fl) {
+    fl->seqno = 0;
+    f->tx_acked++;
+  }
+  _umac_frag_tx_pump(f);
+  if (fl) _umac_frag_tx_finish(f);
+  return fl != 0;
+}
+
+int umac_frag_on_timeout(umac_frag *f, uint8_t seqno) {
+  umac_frag_inflight *fl = _umac_frag_find(f, seqno);
+  if (fl) {
+    fl->seqno = 0;
+    f->tx_failed = 1;
+    _umac_frag_tx_finish(f);
+  } else {
+    _umac_frag_tx_pump(f);
+  }
+  return fl != 0;
+}
+
+void umac_frag_rx(umac_frag *f, uint8_t *data, uint16_t len) {
+  if (len < UMAC_FRAG_HDR_LEN - 1) return;
+  uint8_t msgid = data[0];
+  uint8_t last = (data[1] & UMAC_FRAG_LAST) != 0;
+  uint16_t ix = ((data[1] & ~UMAC_FRAG_LAST) << 8) | data[2];
+  data += UMAC_FRAG_HDR_LEN - 1;
+  len -= UMAC_FRAG_HDR_LEN - 1;
+
+  if (!f->rx_active || f->rx_msgid != msgid) {
+    if (!f->rx_active && f->rx_done_msgid == msgid && f->rx_cnt) {
+      return; // resent fragment of an already reassembled message
+    }
+    if (f->rx_active) f->rx_dropped++;
+    f->rx_active = 1;
+    f->rx_msgid = msgid;
+    f->rx_frags = 0;
+    f->rx_cnt = 0;
+    f->rx_len = 0;
+    memset(f->rx_map, 0, sizeof(f->rx_map));
+  }
+
+  uint32_t offs = (uint32_t)ix * UMAC_FRAG_DATA_LEN;
+  if (ix >= UMAC_FRAG_MAX_FRAGS || offs + len > CFG_UMAC_FRAG_MAX_LEN ||
+      (!last && len != UMAC_FRAG_DATA_LEN)) {
+    // bad fragment, drop whole message
+    f->rx_active = 0;
+    f->rx_cnt = 0;
+    f->rx_dropped++;
+    return;
+  }
+  if (f->rx_map[ix >> 3] & (1 << (ix & 7))) {
+    return; // duplicate
+  }
+  f->rx_map[ix >> 3] |= (1 << (ix & 7));
+  memcpy(&f->rx_buf[offs], data, len);
+  f->rx_cnt++;
+  if (last) {
+    f->rx_frags = ix + 1;
+    f->rx_len = offs + len;
+  }
+  if (f->rx_frags && f->rx_cnt == f->rx_frags) {
+    f->rx_active = 0;
+    f->rx_done_msgid = msgid;
+    f->cfg.rx_msg_fn(f->rx_buf, f->rx_len);
+  }
+}
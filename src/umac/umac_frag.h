@@ -0,0 +1,118 @@
+/*
+ * umac_frag.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+/*
+ * Fragmentation and reassembly of messages larger than one umac packet.
+ *
+ * A message of up to CFG_UMAC_FRAG_MAX_LEN bytes is split into fragments,
+ * each sent as a synchronized umac packet:
+ *   [container id][msgid][last<<7 | index_hi][index_lo]<fragment data>
+ * All fragments but the last carry UMAC_FRAG_DATA_LEN bytes. The receiver
+ * places each fragment by its index into the reassembly buffer, so fragments
+ * may be acked and resent in any order within the umac tx window.
+ * When a message is complete, rx_msg_fn is called from within the umac rx
+ * callback of the final fragment. Hence, the user may reply with
+ * umac_tx_reply_ack in rx_msg_fn, piggybacking on the last fragment's ack.
+ *
+ * umac_frag does not own any umac callbacks. The user must dispatch
+ * fragment packets to umac_frag_rx, and report all acks and timeouts to
+ * umac_frag_on_ack and umac_frag_on_timeout.
+ */
+
+#ifndef _UMAC_FRAG_H_
+#define _UMAC_FRAG_H_
+
+#include "umac.h"
+
+#ifndef CFG_UMAC_FRAG_MAX_LEN
+#define CFG_UMAC_FRAG_MAX_LEN        2048
+#endif
+
+#define UMAC_FRAG_HDR_LEN            4
+#define UMAC_FRAG_DATA_LEN           (768 - UMAC_FRAG_HDR_LEN)
+#define UMAC_FRAG_MAX_FRAGS          \
+  ((CFG_UMAC_FRAG_MAX_LEN + UMAC_FRAG_DATA_LEN - 1) / UMAC_FRAG_DATA_LEN)
+
+#if CFG_UMAC_FRAG_MAX_LEN > 0xffff
+#error CFG_UMAC_FRAG_MAX_LEN must fit in 16 bits
+#endif
+
+#define UMAC_FRAG_LAST               0x80
+
+typedef int (* umac_frag_tx_fn)(const umac_seg *segs, uint8_t nsegs);
+typedef void (* umac_frag_rx_msg_fn)(uint8_t *data, uint16_t len);
+typedef void (* umac_frag_tx_done_fn)(uint8_t msgid, int res);
+
+typedef struct {
+  uint8_t seqno; // 0 if free
+  uint8_t hdr[UMAC_FRAG_HDR_LEN];
+  umac_seg segs[2];
+} umac_frag_inflight;
+
+typedef struct {
+  /** Sends a synchronized packet, returns seqno or -1 if the window is full */
+  umac_frag_tx_fn tx_fn;
+  /** Called when a message is reassembled */
+  umac_frag_rx_msg_fn rx_msg_fn;
+  /** Optional, called when a message is acked (res 0) or timed out (res -1)
+      and its data no longer is referenced */
+  umac_frag_tx_done_fn tx_done_fn;
+  /** Protocol id prefixing outgoing fragments */
+  uint8_t container_id;
+} umac_frag_cfg;
+
+typedef struct {
+  umac_frag_cfg cfg;
+
+  const uint8_t *tx_data;
+  uint16_t tx_len;
+  uint16_t tx_frags;
+  uint16_t tx_next_ix;
+  uint16_t tx_acked;
+  uint8_t tx_msgid;
+  uint8_t tx_busy;
+  uint8_t tx_failed;
+  umac_frag_inflight tx_inflight[CFG_UMAC_TX_WINDOW];
+
+  uint8_t rx_active;
+  uint8_t rx_msgid;
+  uint8_t rx_done_msgid;
+  uint16_t rx_frags;
+  uint16_t rx_cnt;
+  uint16_t rx_len;
+  uint32_t rx_dropped;
+  uint8_t rx_map[(UMAC_FRAG_MAX_FRAGS + 7) / 8];
+  uint8_t rx_buf[CFG_UMAC_FRAG_MAX_LEN];
+} umac_frag;
+
+/**
+ * Initiates fragmentation layer with given configuration.
+ */
+void umac_frag_init(umac_frag *f, umac_frag_cfg *cfg);
+/**
+ * Sends a message as fragments. Data must be kept intact until
+ * tx_done_fn is called. Returns message id, or -1 if a message
+ * already is being sent or the message is too long.
+ */
+int umac_frag_tx(umac_frag *f, const uint8_t *data, uint16_t len);
+/**
+ * Call for every received fragment, data following the container id.
+ */
+void umac_frag_rx(umac_frag *f, uint8_t *data, uint16_t len);
+/**
+ * Call for every acked synchronized packet. Returns nonzero if the
+ * seqno was a fragment. Any ack may free tx window, so pending
+ * fragments are sent from here.
+ */
+int umac_frag_on_ack(umac_frag *f, uint8_t seqno);
+/**
+ * Call for every timed out synchronized packet. Returns nonzero if
+ * the seqno was a fragment, whereas the whole message is failed.
+ */
+int umac_frag_on_timeout(umac_frag *f, uint8_t seqno);
+
+#endif /* _UMAC_FRAG_H_ */
@@ -0,0 +1,88 @@
+/*
+ * umac_lz.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#include "umac_lz.h"
+
+static inline uint16_t _umac_lz_hash(const uint8_t *p) {
+  uint32_t v = (p[0] << 16) | (p[1] << 8) | p[2];
+  return (uint32_t)(v * 2654435761UL) >> (32 - CFG_UMAC_LZ_HASH_BITS);
+}
+
+int umac_lz_compress(umac_lz_enc *lz, const uint8_t *src, uint16_t len,
+    uint8_t *dst, uint16_t dst_len) {
+  uint16_t i = 0;
+  uint16_t o = 0;
+  uint16_t flag_pos = 0;
+  uint8_t bit = 8;
+  // positions are stored plus one, zero is empty
+  memset(lz->head, 0, sizeof(lz->head));
+  while (i < len) {
+    if (bit == 8) {
+      if (o >= dst_len) return -1;
+      flag_pos = o++;
+      dst[flag_pos] = 0;
+      bit = 0;
+    }
+    uint16_t mlen = 0;
+    uint16_t cand = 0;
+    if (i + UMAC_LZ_MIN_MATCH <= len) {
+      uint16_t h = _umac_lz_hash(&src[i]);
+      cand = lz->head[h];
+      lz->head[h] = i + 1;
+      if (cand && i - (cand - 1) <= UMAC_LZ_MAX_OFFS) {
+        cand--;
+        uint16_t max = len - i < UMAC_LZ_MAX_MATCH ? len - i : UMAC_LZ_MAX_MATCH;
+        while (mlen < max && src[cand + mlen] == src[i + mlen]) mlen++;
+      }
+    }
+    if (mlen >= UMAC_LZ_MIN_MATCH) {
+      if (o + 2 > dst_len) return -1;
+      uint16_t offs = i - cand - 1;
+      dst[o++] = ((mlen - UMAC_LZ_MIN_MATCH) << 4) | (offs >> 8);
+      dst[o++] = offs;
+      dst[flag_pos] |= (1 << bit);
+      // index positions covered by the match
+      uint16_t k;
+      for (k = i + 1; k < i + mlen && k + UMAC_LZ_MIN_MATCH <= len; k++) {
+        lz->head[_umac_lz_hash(&src[k])] = k + 1;
+      }
+      i += mlen;
+    } else {
+      if (o >= dst_len) return -1;
+      dst[o++] = src[i++];
+    }
+    bit++;
+  }
+  return o;
+}
+
+int umac_lz_decompress(const uint8_t *src, uint16_t len,
+    uint8_t *dst, uint16_t dst_len) {
+  uint16_t i = 0;
+  uint16_t o = 0;
+  while (i < len) {
+    uint8_t flags = src[i++];
+    uint8_t bit;
+    for (bit = 0; bit < 8 && i < len; bit++) {
+      if (flags & (1 << bit)) {
+        if (i + 2 > len) return -1;
+        uint16_t mlen = (src[i] >> 4) + UMAC_LZ_MIN_MATCH;
+        uint16_t offs = (((src[i] & 0x0f) << 8) | src[i + 1]) + 1;
+        i += 2;
+        if (offs > o || o + mlen > dst_len) return -1;
+        while (mlen--) {
+          dst[o] = dst[o - offs];
+          o++;
+        }
+      } else {
+        if (o >= dst_len) return -1;
+        dst[o++] = src[i++];
+      }
+    }
+  }
+  return o;
+}
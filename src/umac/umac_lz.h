@@ -0,0 +1,55 @@
+/*
+ * umac_lz.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+/*
+ * Small LZSS compressor for umac payloads.
+ *
+ * The stream is a sequence of groups, each a flag byte followed by up to
+ * eight items. Flag bit n set means item n is a back reference
+ *   [len - UMAC_LZ_MIN_MATCH : 4 | offs_hi : 4][offs_lo]
+ * copying len bytes from offs + 1 bytes back in the output, otherwise item
+ * n is a literal byte.
+ *
+ * The whole input must be in memory, so the window is the input itself.
+ * The encoder finds matches by hashing three bytes into a table of
+ * 1 << CFG_UMAC_LZ_HASH_BITS entries, keeping only the latest position per
+ * hash. The decoder needs no memory but the output buffer.
+ */
+
+#ifndef _UMAC_LZ_H_
+#define _UMAC_LZ_H_
+
+#include "umac.h"
+
+#ifndef CFG_UMAC_LZ_HASH_BITS
+#define CFG_UMAC_LZ_HASH_BITS        8
+#endif
+
+#define UMAC_LZ_MIN_MATCH            3
+#define UMAC_LZ_MAX_MATCH            (UMAC_LZ_MIN_MATCH + 15)
+#define UMAC_LZ_MAX_OFFS             4096
+
+typedef struct {
+  uint16_t head[1 << CFG_UMAC_LZ_HASH_BITS];
+} umac_lz_enc;
+
+/**
+ * Compresses len bytes from src into dst, which can hold dst_len bytes.
+ * Returns compressed length, or -1 if it does not fit in dst_len. Passing
+ * dst_len less than len hence makes incompressible data fail early.
+ */
+int umac_lz_compress(umac_lz_enc *lz, const uint8_t *src, uint16_t len,
+    uint8_t *dst, uint16_t dst_len);
+/**
+ * Decompresses len bytes from src into dst, which can hold dst_len bytes.
+ * Returns decompressed length, or -1 if the data is corrupt or does not
+ * fit.
+ */
+int umac_lz_decompress(const uint8_t *src, uint16_t len,
+    uint8_t *dst, uint16_t dst_len);
+
+#endif /* _UMAC_LZ_H_ */
@@ -15,7 +15,15 @@
 #define CFG_UMAC_RETRIES             10
 #define CFG_UMAC_RETRY_DELTA(t)      40
 #define CFG_UMAC_RX_TIMEOUT          2*CFG_UMAC_RETRY_DELTA(1)*CFG_UMAC_RETRIES
+#define CFG_UMAC_ADAPTIVE_RTO
+#define CFG_UMAC_STATS
+#define CFG_UMAC_SLIP
+#define CFG_UMAC_LZ
+#define CFG_UMAC_FRAG_MAX_LEN        1536
+#define CFG_UMAC_RTO_MIN             4
+#define CFG_UMAC_RTO_MAX             160
 #define CFG_UMAC_TICK_TYPE           sys_time
+#define CFG_UMAC_CRC                 UMAC_CRC_SLICE4
 #define CFG_UMAC_DBG(...) DBG(D_COMM, D_DEBUG, "UM " __VA_ARGS__ )
 
 #endif /* _UMAC_CFG_H_ */
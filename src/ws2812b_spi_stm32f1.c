@@ -25,6 +25,19 @@
  * Divide codes into 3 steps => 0.8MHz * 3 = 2.4 MHz
  *   36/2.4 = 15 optimal divider, use 16
  *
+ * WS2812B_STREAM
+ *   Instead of coding all leds up front, rgb is kept 3 bytes per led and
+ *   coded just in time into a circular dma buffer of two halves, each
+ *   WS2812B_STREAM_LEDS leds. Whenever dma is done with a half, the half
+ *   and transfer complete irqs refill it with the next leds. The first half
+ *   sent is zeroes for reset, and the transfer is stopped once a full half
+ *   of zeroes has followed the last led.
+ *
+ * Double buffering
+ *   Leds are set into a back buffer while the front buffer is sent. Output
+ *   swaps them, or if the front is still being sent, queues the back buffer
+ *   to be swapped in and sent from the dma irq. Setting leds while a frame
+ *   is queued drops the queued frame, so a frame is never sent half set.
  *
  */
 
@@ -32,6 +45,7 @@
 #include "system.h"
 #include "gpio.h"
 #include "ws2812b_spi_stm32f1.h"
+#include "processor.h"
 
 #ifndef WS2812B_NBR_OF_LEDS
 #define WS2812B_NBR_OF_LEDS 24
@@ -45,12 +59,78 @@
 
 #define RGB_DATA_LEN \
   (3 * WS2812B_NBR_OF_LEDS * CODED_BYTES_PER_RGB_BYTE)
+#define RGB_SEND_LEN \
+  (RESET_LEN + RGB_DATA_LEN + RESET_LEN + 1)
+// keeps both buffers word aligned
+#define RGB_BUF_LEN \
+  ((RGB_SEND_LEN + 3) & ~3)
+
+#ifdef WS2812B_STREAM
+#ifndef WS2812B_STREAM_LEDS
+#define WS2812B_STREAM_LEDS       8
+#endif
+#if (WS2812B_STREAM_LEDS % 4) != 0
+#error WS2812B_STREAM_LEDS must be a multiple of 4
+#endif
+#define STREAM_HALF_LEN \
+  (3 * WS2812B_STREAM_LEDS * CODED_BYTES_PER_RGB_BYTE)
+#endif
 
 #define CODE0 0b100
 #define CODE1 0b110
 
-static u8_t rgb_data[RESET_LEN + RGB_DATA_LEN + RESET_LEN + 1];
+// each byte coded as 8 codes, msb first, 3 bytes in the low 24 bits
+static const u32_t codes[256] = {
+    0x924924, 0x924926, 0x924934, 0x924936, 0x9249a4, 0x9249a6, 0x9249b4, 0x9249b6,
+    0x924d24, 0x924d26, 0x924d34, 0x924d36, 0x924da4, 0x924da6, 0x924db4, 0x924db6,
+    0x926924, 0x926926, 0x926934, 0x926936, 0x9269a4, 0x9269a6, 0x9269b4, 0x9269b6,
+    0x926d24, 0x926d26, 0x926d34, 0x926d36, 0x926da4, 0x926da6, 0x926db4, 0x926db6,
+    0x934924, 0x934926, 0x934934, 0x934936, 0x9349a4, 0x9349a6, 0x9349b4, 0x9349b6,
+    0x934d24, 0x934d26, 0x934d34, 0x934d36, 0x934da4, 0x934da6, 0x934db4, 0x934db6,
+    0x936924, 0x936926, 0x936934, 0x936936, 0x9369a4, 0x9369a6, 0x9369b4, 0x9369b6,
+    0x936d24, 0x936d26, 0x936d34, 0x936d36, 0x936da4, 0x936da6, 0x936db4, 0x936db6,
+    0x9a4924, 0x9a4926, 0x9a4934, 0x9a4936, 0x9a49a4, 0x9a49a6, 0x9a49b4, 0x9a49b6,
+    0x9a4d24, 0x9a4d26, 0x9a4d34, 0x9a4d36, 0x9a4da4, 0x9a4da6, 0x9a4db4, 0x9a4db6,
+    0x9a6924, 0x9a6926, 0x9a6934, 0x9a6936, 0x9a69a4, 0x9a69a6, 0x9a69b4, 0x9a69b6,
+    0x9a6d24, 0x9a6d26, 0x9a6d34, 0x9a6d36, 0x9a6da4, 0x9a6da6, 0x9a6db4, 0x9a6db6,
+    0x9b4924, 0x9b4926, 0x9b4934, 0x9b4936, 0x9b49a4, 0x9b49a6, 0x9b49b4, 0x9b49b6,
+    0x9b4d24, 0x9b4d26, 0x9b4d34, 0x9b4d36, 0x9b4da4, 0x9b4da6, 0x9b4db4, 0x9b4db6,
+    0x9b6924, 0x9b6926, 0x9b6934, 0x9b6936, 0x9b69a4, 0x9b69a6, 0x9b69b4, 0x9b69b6,
+    0x9b6d24, 0x9b6d26, 0x9b6d34, 0x9b6d36, 0x9b6da4, 0x9b6da6, 0x9b6db4, 0x9b6db6,
+    0xd24924, 0xd24926, 0xd24934, 0xd24936, 0xd249a4, 0xd249a6, 0xd249b4, 0xd249b6,
+    0xd24d24, 0xd24d26, 0xd24d34, 0xd24d36, 0xd24da4, 0xd24da6, 0xd24db4, 0xd24db6,
+    0xd26924, 0xd26926, 0xd26934, 0xd26936, 0xd269a4, 0xd269a6, 0xd269b4, 0xd269b6,
+    0xd26d24, 0xd26d26, 0xd26d34, 0xd26d36, 0xd26da4, 0xd26da6, 0xd26db4, 0xd26db6,
+    0xd34924, 0xd34926, 0xd34934, 0xd34936, 0xd349a4, 0xd349a6, 0xd349b4, 0xd349b6,
+    0xd34d24, 0xd34d26, 0xd34d34, 0xd34d36, 0xd34da4, 0xd34da6, 0xd34db4, 0xd34db6,
+    0xd36924, 0xd36926, 0xd36934, 0xd36936, 0xd369a4, 0xd369a6, 0xd369b4, 0xd369b6,
+    0xd36d24, 0xd36d26, 0xd36d34, 0xd36d36, 0xd36da4, 0xd36da6, 0xd36db4, 0xd36db6,
+    0xda4924, 0xda4926, 0xda4934, 0xda4936, 0xda49a4, 0xda49a6, 0xda49b4, 0xda49b6,
+    0xda4d24, 0xda4d26, 0xda4d34, 0xda4d36, 0xda4da4, 0xda4da6, 0xda4db4, 0xda4db6,
+    0xda6924, 0xda6926, 0xda6934, 0xda6936, 0xda69a4, 0xda69a6, 0xda69b4, 0xda69b6,
+    0xda6d24, 0xda6d26, 0xda6d34, 0xda6d36, 0xda6da4, 0xda6da6, 0xda6db4, 0xda6db6,
+    0xdb4924, 0xdb4926, 0xdb4934, 0xdb4936, 0xdb49a4, 0xdb49a6, 0xdb49b4, 0xdb49b6,
+    0xdb4d24, 0xdb4d26, 0xdb4d34, 0xdb4d36, 0xdb4da4, 0xdb4da6, 0xdb4db4, 0xdb4db6,
+    0xdb6924, 0xdb6926, 0xdb6934, 0xdb6936, 0xdb69a4, 0xdb69a6, 0xdb69b4, 0xdb69b6,
+    0xdb6d24, 0xdb6d26, 0xdb6d34, 0xdb6d36, 0xdb6da4, 0xdb6da6, 0xdb6db4, 0xdb6db6,
+};
+
+#ifdef WS2812B_STREAM
+static u8_t rgb_fb[2][3 * WS2812B_NBR_OF_LEDS];
+static const u8_t *stream_fb;
+static u8_t stream_data[2 * STREAM_HALF_LEN] __attribute__((aligned(4)));
+static u32_t stream_led;
+static u8_t stream_tail;
+#else
+// word aligned, whole groups of leds are coded with word stores
+static u8_t rgb_data[2][RGB_BUF_LEN] __attribute__((aligned(4)));
+#endif
 static u32_t rgb_ix;
+static u8_t back;
+static volatile bool sending;
+static volatile bool queued;
+static ws2812b_stats stats;
+static u32_t send_cycles;
 static void (* _cb)(bool error);
 
 void WS2812B_STM32F1_init(void (* callback)(bool error)) {
@@ -80,7 +160,11 @@ void WS2812B_STM32F1_init(void (* callback)(bool error)) {
   dma_conf.DMA_MemoryInc = DMA_MemoryInc_Enable;
   dma_conf.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
   dma_conf.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+#ifdef WS2812B_STREAM
+  dma_conf.DMA_Mode = DMA_Mode_Circular;
+#else
   dma_conf.DMA_Mode = DMA_Mode_Normal;
+#endif
   dma_conf.DMA_Priority = DMA_Priority_VeryHigh;
   dma_conf.DMA_M2M = DMA_M2M_Disable;
 
@@ -93,8 +177,13 @@ void WS2812B_STM32F1_init(void (* callback)(bool error)) {
   // Enable SPI_MASTER DMA Tx request
   SPI_I2S_DMACmd(SPI2, SPI_I2S_DMAReq_Tx , ENABLE);
 
+#ifdef WS2812B_STREAM
+  // Enable dma half transfer, transfer complete and transfer error interrupts
+  DMA_ITConfig(DMA1_Channel5, DMA_IT_HT | DMA_IT_TC | DMA_IT_TE, ENABLE);
+#else
   // Enable dma transfer complete and transfer error interrupts
   DMA_ITConfig(DMA1_Channel5, DMA_IT_TC | DMA_IT_TE, ENABLE);
+#endif
 
   // config io
   // pin B15 WS2812B as output high
@@ -103,6 +192,13 @@ void WS2812B_STM32F1_init(void (* callback)(bool error)) {
   gpio_disable(PORTB, PIN15);
 
 
+  back = 0;
+  sending = FALSE;
+  queued = FALSE;
+#ifdef WS2812B_STREAM
+  memset(rgb_fb, 0x00, sizeof(rgb_fb));
+  rgb_ix = 0;
+#else
   memset(rgb_data, 0x00, sizeof(rgb_data));
 
   //memset(rgb_data, 0xff, sizeof(rgb_data));
@@ -110,79 +206,261 @@ void WS2812B_STM32F1_init(void (* callback)(bool error)) {
   //memset(&rgb_data[RESET_LEN + RGB_DATA_LEN], 0x00, RESET_ZEROES);
 
   rgb_ix = RESET_LEN;
+#endif
 }
 
-void ws2812b_stm32f1_codify(u8_t d) {
-  if (rgb_ix >= RESET_LEN + RGB_DATA_LEN) return;
+static void ws2812b_stm32f1_codify_to(u8_t *dst, u8_t d) {
   //012345670123456701234567
   //00_11_22_33_44_55_66_77_
-  int i;
-  u32_t o = 0;
-  for (i = 0; i < 8; i++) {
-    o <<= 3;
-    o |= d & 0b10000000 ? CODE1 : CODE0;
-    d <<= 1;
+  u32_t o = codes[d];
+  dst[0] = (o >> 16) & 0xff;
+  dst[1] = (o >> 8) & 0xff;
+  dst[2] = o & 0xff;
+}
+
+// called before setting leds, a queued frame is about to be overwritten
+static bool ws2812b_stm32f1_unqueue(void) {
+  bool dropped = FALSE;
+  irq_disable();
+  if (queued) {
+    queued = FALSE;
+    stats.dropped++;
+    dropped = TRUE;
+  }
+  irq_enable();
+  return dropped;
+}
+
+#ifndef WS2812B_STREAM
+void ws2812b_stm32f1_codify(u8_t d) {
+  if (rgb_ix >= RESET_LEN + RGB_DATA_LEN) return;
+  ws2812b_stm32f1_codify_to(&rgb_data[back][rgb_ix], d);
+  rgb_ix += 3;
+}
+#endif
+
+// codes four bytes into three words, dst must be word aligned
+static void ws2812b_stm32f1_codify4(u32_t *dst, u8_t d0, u8_t d1, u8_t d2, u8_t d3) {
+  u32_t c0 = codes[d0];
+  u32_t c1 = codes[d1];
+  u32_t c2 = codes[d2];
+  u32_t c3 = codes[d3];
+  // spi sends lowest address first, so byte order is reversed per word
+  dst[0] = __REV((c0 << 8) | (c1 >> 16));
+  dst[1] = __REV((c1 << 16) | (c2 >> 8));
+  dst[2] = __REV((c2 << 24) | c3);
+}
+
+// codes groups of four leds from rgb to dst, returns dst after last group
+static u32_t *ws2812b_stm32f1_codify_groups(u32_t *dst, const u8_t *rgb, u32_t groups) {
+  while (groups--) {
+    //grb
+    ws2812b_stm32f1_codify4(&dst[0], rgb[1], rgb[0], rgb[2], rgb[4]);
+    ws2812b_stm32f1_codify4(&dst[3], rgb[3], rgb[5], rgb[7], rgb[6]);
+    ws2812b_stm32f1_codify4(&dst[6], rgb[8], rgb[10], rgb[9], rgb[11]);
+    dst += 9;
+    rgb += 12;
   }
-  rgb_data[rgb_ix++] = (o >> 16) & 0xff;
-  rgb_data[rgb_ix++] = (o >> 8) & 0xff;
-  rgb_data[rgb_ix++] = o & 0xff;
+  return dst;
 }
 
+#ifdef WS2812B_STREAM
+
 void WS2812B_STM32F1_set(u32_t rgb) {
+  if (queued) ws2812b_stm32f1_unqueue();
+  if (rgb_ix >= sizeof(rgb_fb[0])) return;
+  rgb_fb[back][rgb_ix++] = (rgb>>16) & 0xff;
+  rgb_fb[back][rgb_ix++] = (rgb>>8) & 0xff;
+  rgb_fb[back][rgb_ix++] = rgb & 0xff;
+}
+
+void WS2812B_STM32F1_set_rgb(const u8_t *rgb, u32_t leds) {
+  if (queued) ws2812b_stm32f1_unqueue();
+  u32_t len = MIN(leds * 3, sizeof(rgb_fb[0]) - rgb_ix);
+  memcpy(&rgb_fb[back][rgb_ix], rgb, len);
+  rgb_ix += len;
+}
+
+// codes next leds into given half, or zeroes if all leds are sent
+static void ws2812b_stm32f1_stream_fill(u8_t *half) {
+  u32_t leds = MIN(WS2812B_STREAM_LEDS, WS2812B_NBR_OF_LEDS - stream_led);
+  if (leds == 0) {
+    memset(half, 0x00, STREAM_HALF_LEN);
+    stream_tail++;
+    return;
+  }
+  const u8_t *rgb = &stream_fb[stream_led * 3];
+  u8_t *dst = (u8_t *)ws2812b_stm32f1_codify_groups((u32_t *)half, rgb, leds / 4);
+  rgb += (leds & ~3) * 3;
+  u32_t i;
+  for (i = 0; i < (leds & 3); i++) {
+    //grb
+    ws2812b_stm32f1_codify_to(&dst[0], rgb[1]);
+    ws2812b_stm32f1_codify_to(&dst[3], rgb[0]);
+    ws2812b_stm32f1_codify_to(&dst[6], rgb[2]);
+    dst += 9;
+    rgb += 3;
+  }
+  memset(dst, 0x00, &half[STREAM_HALF_LEN] - dst);
+  stream_led += leds;
+}
+
+#else
+
+void WS2812B_STM32F1_set(u32_t rgb) {
+  if (queued) ws2812b_stm32f1_unqueue();
   //grb
   ws2812b_stm32f1_codify((rgb>>8) & 0xff);
   ws2812b_stm32f1_codify((rgb>>16) & 0xff);
   ws2812b_stm32f1_codify(rgb & 0xff);
 }
 
-void WS2812B_STM32F1_output(void) {
+void WS2812B_STM32F1_set_rgb(const u8_t *rgb, u32_t leds) {
+  if (queued) ws2812b_stm32f1_unqueue();
+  if ((rgb_ix & 3) == 0) {
+    // four leds, twelve bytes, at a time
+    u32_t groups = MIN(leds, (RESET_LEN + RGB_DATA_LEN - rgb_ix) / 9) / 4;
+    ws2812b_stm32f1_codify_groups((u32_t *)&rgb_data[back][rgb_ix], rgb, groups);
+    leds -= groups * 4;
+    rgb_ix += groups * 4 * 9;
+    rgb += groups * 4 * 3;
+  }
+  while (leds--) {
+    //grb
+    ws2812b_stm32f1_codify(rgb[1]);
+    ws2812b_stm32f1_codify(rgb[0]);
+    ws2812b_stm32f1_codify(rgb[2]);
+    rgb += 3;
+  }
+}
+
+#endif
+
+// starts sending back buffer and swaps, irqs must be disabled
+static void ws2812b_stm32f1_send(void) {
   gpio_config(PORTB, PIN15, CLK_50MHZ, AF, AF0, PUSHPULL, NOPULL);
 
   DMA1_Channel5->CCR &= (u16_t)(~DMA_CCR1_EN);
 
-  DMA1_Channel5->CNDTR = RESET_LEN + RGB_DATA_LEN + RESET_LEN + 1;
-  DMA1_Channel5->CMAR = (u32_t)(&rgb_data[0]);
+#ifdef WS2812B_STREAM
+  // first half is reset, second the first leds
+  stream_fb = rgb_fb[back];
+  stream_led = 0;
+  stream_tail = 0;
+  memset(stream_data, 0x00, STREAM_HALF_LEN);
+  ws2812b_stm32f1_stream_fill(&stream_data[STREAM_HALF_LEN]);
+  DMA1_Channel5->CCR |= DMA_CCR1_CIRC;
+  DMA1_Channel5->CNDTR = sizeof(stream_data);
+  DMA1_Channel5->CMAR = (u32_t)(&stream_data[0]);
+#else
+  DMA1_Channel5->CNDTR = RGB_SEND_LEN;
+  DMA1_Channel5->CMAR = (u32_t)(&rgb_data[back][0]);
+#endif
 
   DMA1_Channel5->CCR |= DMA_CCR1_EN;
   SPI2->CR1 |= 0x0040;
 
-  rgb_ix = 1;
+  back ^= 1;
+  sending = TRUE;
+  send_cycles = DWT_CYCCNT;
 }
 
-void WS2812B_STM32F1_output_test_pattern(void) {
-  int i;
-  for (i = 0; i < RGB_DATA_LEN; i++) {
-    rgb_data[RESET_LEN + i] = 0xaa;
+bool WS2812B_STM32F1_output(void) {
+  bool started;
+  irq_disable();
+  if (sending) {
+    // swapped in by irq when current frame is sent
+    queued = TRUE;
+    stats.overlaps++;
+    started = FALSE;
+  } else {
+    ws2812b_stm32f1_send();
+    started = TRUE;
   }
-  gpio_config(PORTB, PIN15, CLK_50MHZ, AF, AF0, PUSHPULL, NOPULL);
+  irq_enable();
+#ifdef WS2812B_STREAM
+  rgb_ix = 0;
+#else
+  rgb_ix = RESET_LEN;
+#endif
+  return started;
+}
 
-  DMA1_Channel5->CCR &= (u16_t)(~DMA_CCR1_EN);
+void WS2812B_STM32F1_output_test_pattern(void) {
+  if (queued) ws2812b_stm32f1_unqueue();
+#ifdef WS2812B_STREAM
+  // leds are coded just in time, so pattern is sent as led data
+  memset(rgb_fb[back], 0xaa, sizeof(rgb_fb[0]));
+#else
+  memset(&rgb_data[back][RESET_LEN], 0xaa, RGB_DATA_LEN);
+#endif
+  WS2812B_STM32F1_output();
+}
 
-  DMA1_Channel5->CNDTR = RGB_DATA_LEN;
-  DMA1_Channel5->CMAR = (u32_t)(&rgb_data[RESET_LEN]);
+bool WS2812B_STM32F1_unqueue(void) {
+  return ws2812b_stm32f1_unqueue();
+}
 
-  DMA1_Channel5->CCR |= DMA_CCR1_EN;
-  SPI2->CR1 |= 0x0040;
+bool WS2812B_STM32F1_busy(void) {
+  return sending;
+}
 
-  rgb_ix = 1;
+void WS2812B_STM32F1_get_stats(ws2812b_stats *dst, bool reset) {
+  irq_disable();
+  memcpy(dst, &stats, sizeof(ws2812b_stats));
+  if (reset) memset(&stats, 0, sizeof(ws2812b_stats));
+  irq_enable();
 }
 
 void DMA1_Channel5_IRQHandler() {
   bool do_call = FALSE;
   bool err = FALSE;
+#ifdef WS2812B_STREAM
+  if (DMA_GetITStatus(DMA1_IT_HT5)) {
+    DMA_ClearITPendingBit(DMA1_IT_HT5);
+    if (stream_tail < 2) {
+      ws2812b_stm32f1_stream_fill(&stream_data[0]);
+    } else {
+      do_call = TRUE;
+    }
+  }
+  if (DMA_GetITStatus(DMA1_IT_TC5)) {
+    DMA_ClearITPendingBit(DMA1_IT_TC5);
+    if (stream_tail < 2) {
+      ws2812b_stm32f1_stream_fill(&stream_data[STREAM_HALF_LEN]);
+    } else {
+      do_call = TRUE;
+    }
+  }
+#else
   if (DMA_GetITStatus(DMA1_IT_TC5)) {
     do_call = TRUE;
     DMA_ClearITPendingBit(DMA1_IT_TC5);
   }
+#endif
   if (DMA_GetITStatus(DMA1_IT_TE5)) {
     do_call = TRUE;
     err = TRUE;
     DMA_ClearITPendingBit(DMA1_IT_TE5);
   }
-  if (do_call && _cb) {
-    gpio_config(PORTB, PIN15, CLK_50MHZ, OUT, AF0, PUSHPULL, NOPULL);
-    //gpio_enable(PORTB, PIN15);
-    gpio_disable(PORTB, PIN15);
+  if (!do_call) return;
+#ifdef WS2812B_STREAM
+  DMA1_Channel5->CCR &= (u16_t)(~(DMA_CCR1_EN | DMA_CCR1_CIRC));
+#endif
+  u32_t cycles = DWT_CYCCNT - send_cycles;
+  stats.frames++;
+  stats.cycles_sum += cycles;
+  if (cycles > stats.cycles_max) stats.cycles_max = cycles;
+  if (queued) {
+    queued = FALSE;
+    ws2812b_stm32f1_send();
+    return;
+  }
+  sending = FALSE;
+  gpio_config(PORTB, PIN15, CLK_50MHZ, OUT, AF0, PUSHPULL, NOPULL);
+  //gpio_enable(PORTB, PIN15);
+  gpio_disable(PORTB, PIN15);
+  if (_cb) {
     _cb(err);
   }
 }
@@ -10,9 +10,34 @@
 
 #include "system.h"
 
-void WS2812B_STM32F1_output(void);
+typedef struct {
+  u32_t frames;     // frames sent
+  u32_t overlaps;   // output while previous frame was sent, queued
+  u32_t dropped;    // queued frames overwritten before sent
+  u32_t cycles_max; // dma time per frame sent
+  u32_t cycles_sum;
+} ws2812b_stats;
+
+/**
+ * Sends the leds set since last output. Returns TRUE if sending started,
+ * FALSE if queued after the frame being sent. Leds are set into the other
+ * buffer from then on, so all leds must be set for each frame.
+ */
+bool WS2812B_STM32F1_output(void);
 void WS2812B_STM32F1_output_test_pattern(void);
 void WS2812B_STM32F1_set(u32_t rgb);
+void WS2812B_STM32F1_set_rgb(const u8_t *rgb, u32_t leds);
+/**
+ * Callback is called from irq when the last queued frame is sent.
+ */
 void WS2812B_STM32F1_init(void (* callback)(bool error));
+/**
+ * Drops a frame queued after the frame being sent, as setting leds does.
+ * Returns TRUE if there was one, FALSE if none was queued or it already
+ * is being sent.
+ */
+bool WS2812B_STM32F1_unqueue(void);
+bool WS2812B_STM32F1_busy(void);
+void WS2812B_STM32F1_get_stats(ws2812b_stats *dst, bool reset);
 
 #endif /* WS2812B_SPI_STM32F1_H_ */